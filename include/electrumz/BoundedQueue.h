@@ -0,0 +1,77 @@
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+namespace electrumz {
+	namespace util {
+		/**
+		 * Fixed capacity queue used to link pipeline stages together.
+		 * Push blocks while the queue is full so a slow stage applies backpressure
+		 * to the stages feeding it instead of buffering without limit.
+		*/
+		template<typename T>
+		class BoundedQueue {
+		public:
+			BoundedQueue(size_t capacity) : capacity(capacity) { }
+
+			/**
+			 * Adds an item, waits for space if the queue is full.
+			 * Returns false if the queue was closed.
+			*/
+			bool Push(T&& item) {
+				std::unique_lock<std::mutex> lk(this->lock);
+				this->not_full.wait(lk, [this] { return this->closed || this->items.size() < this->capacity; });
+				if (this->closed) {
+					return false;
+				}
+
+				this->items.push(std::move(item));
+				this->not_empty.notify_one();
+				return true;
+			}
+
+			/**
+			 * Takes the next item, waits for one if the queue is empty.
+			 * Returns false once the queue is closed and fully drained.
+			*/
+			bool Pop(T& item) {
+				std::unique_lock<std::mutex> lk(this->lock);
+				this->not_empty.wait(lk, [this] { return this->closed || !this->items.empty(); });
+				if (this->items.empty()) {
+					return false;
+				}
+
+				item = std::move(this->items.front());
+				this->items.pop();
+				this->not_full.notify_one();
+				return true;
+			}
+
+			/**
+			 * No more items will be pushed, wakes up all waiting threads.
+			 * Items already in the queue can still be popped.
+			*/
+			void Close() {
+				std::lock_guard<std::mutex> lk(this->lock);
+				this->closed = true;
+				this->not_empty.notify_all();
+				this->not_full.notify_all();
+			}
+
+			size_t Size() {
+				std::lock_guard<std::mutex> lk(this->lock);
+				return this->items.size();
+			}
+		private:
+			const size_t capacity;
+			bool closed = false;
+
+			std::queue<T> items;
+			std::mutex lock;
+			std::condition_variable not_empty;
+			std::condition_variable not_full;
+		};
+	}
+}
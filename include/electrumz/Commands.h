@@ -7,6 +7,7 @@
 #include <nlohmann/json.hpp>
 #include <electrumz/bitcoin/uint256.h>
 #include <electrumz/bitcoin/hash.h>
+#include <electrumz/TXO.h>
 
 namespace electrumz {
 	namespace commands {
@@ -95,17 +96,22 @@ namespace electrumz {
 
 		class ScriptStatus {
 		public:
+			//confirmed history, hashed as its blocks were stored
+			AddrStatus confirmed;
+
+			//mempool txs, hashed after the confirmed ones
 			std::vector<TxInfo> txn;
 
-			
+			bool Empty() const {
+				return this->confirmed.Empty() && this->txn.empty();
+			}
+
 			uint256 GetStatusHash() const {
-				std::stringstream ss;
-				for (auto tx : txn) {
-					ss << tx.hash << ":" << tx.height;
+				auto status = this->confirmed;
+				for (const auto& tx : this->txn) {
+					status.Append(tx.hash, tx.height);
 				}
-
-				auto str = ss.str();
-				return Hash(str.begin(), str.end());
+				return status.Hash();
 			}
 		};
 
@@ -141,8 +147,8 @@ namespace electrumz {
 
 		class SHGetBalanceResponse {
 		public:
-			std::string confirmed;
-			std::string unconfirmed;
+			int64_t confirmed;
+			int64_t unconfirmed;
 		};
 
 		class SHGetHistoryResponse {
@@ -21,6 +21,24 @@ namespace electrumz {
 			std::string zmqrawtx;
 			std::string zmqrawblock;
 
+			//preload pipeline threads per stage
+			unsigned int preload_read_threads = 1;
+			unsigned int preload_parse_threads = 2;
+			unsigned int preload_hash_threads = 0;
+			unsigned int preload_queue_depth = 64;
+			unsigned int preload_commit_blocks = 500;
+			unsigned int preload_commit_mb = 256;
+			unsigned int preload_cache_outputs = 2000000;
+			bool preload_undo = true;
+
+			//bulk preload sort memory and spill dir (default: next to the db)
+			unsigned int preload_sort_mb = 1024;
+			std::string preload_sort_dir;
+			bool preload_check_merkle = false;
+
+			//scriptHash prefix bytes keying the addr index of a new db, 32 = full hash
+			unsigned int db_addr_key_bytes = 32;
+
 #ifndef ELECTRUMZ_NO_SSL
 			std::string ssl_cert;
 			std::string ssl_key;
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <lmdb.h>
+
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+#include <stdint.h>
+
+namespace electrumz {
+	namespace util {
+		/**
+		 * Sorts more key/value records than fit in memory.
+		 * Records are buffered up to a memory limit, sorted and spilled to run
+		 * files in the background, Merge then does a k-way merge of all runs and
+		 * streams the records back in the same order LMDB stores them
+		 * (keys by memcmp, duplicates by dupCmp or memcmp).
+		*/
+		class ExternalSorter {
+		public:
+			ExternalSorter(const std::string& dir, const std::string& name, uint64_t memLimit, MDB_cmp_func* dupCmp = nullptr);
+			~ExternalSorter();
+
+			// Disallow copies
+			ExternalSorter(const ExternalSorter&) = delete;
+			ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+			/**
+			 * Buffers a record, spills a sorted run once the buffer is full.
+			 * Returns 0 on success
+			*/
+			int Add(const void* key, uint32_t klen, const void* val, uint32_t vlen);
+
+			/**
+			 * Spills whatever is still buffered and waits for pending spills.
+			*/
+			int Finish();
+
+			/**
+			 * Streams every record in sorted order to fn, stops at the first
+			 * non-zero return of fn and returns it.
+			 * When there are too many runs to open at once they are merged
+			 * into fewer, larger runs first.
+			 * A run that can't be read back fully fails the merge.
+			*/
+			int Merge(const std::function<int(MDB_val&, MDB_val&)>& fn);
+
+			/**
+			 * Removes all run files
+			*/
+			void Clear();
+
+			const std::string& Name() const { return this->name; }
+			uint64_t Count() const { return this->count; }
+			uint64_t Bytes() const { return this->bytes; }
+
+			/**
+			 * Compares two records in LMDB order
+			*/
+			int Compare(const MDB_val& ka, const MDB_val& va, const MDB_val& kb, const MDB_val& vb) const;
+
+			/**
+			 * Record layout helpers, a record is [klen:4][vlen:4][key][val]
+			*/
+			static void AppendRecord(std::vector<unsigned char>& buf, const MDB_val& k, const MDB_val& v);
+			static size_t ReadRecord(const unsigned char* rec, MDB_val& k, MDB_val& v);
+		private:
+			int Spill();
+			int WriteRun(std::vector<unsigned char>& buf, std::vector<uint64_t>& offsets, const std::string& path);
+			int MergeToRun(const std::vector<std::string>& runs, const std::string& path);
+			int MergeRuns(const std::vector<std::string>& runs, const std::function<int(MDB_val&, MDB_val&)>& fn);
+
+			std::string dir;
+			std::string name;
+			uint64_t memLimit;
+			MDB_cmp_func* dupCmp;
+
+			std::vector<unsigned char> buf;
+			std::vector<uint64_t> offsets;
+
+			std::vector<std::string> runs;
+			std::future<int> pending;
+
+			uint64_t count = 0;
+			uint64_t bytes = 0;
+		};
+	}
+}
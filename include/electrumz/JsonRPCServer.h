@@ -1,7 +1,9 @@
 #pragma once
 
 #include <map>
+#include <deque>
 #include <functional>
+#include <optional>
 #include <uv.h>
 
 #include <nlohmann/json.hpp>
@@ -29,6 +31,30 @@ namespace electrumz {
 #endif
 		};
 
+		/**
+		 * A history response being written one chunk at a time, so a huge history
+		 * never sits in memory. The next chunk is read once the last one is sent.
+		*/
+		class HistoryStream {
+		public:
+			bool active = false;
+			int id = 0;
+			uint256 scriptHash;
+
+			//tx number the next chunk starts at
+			uint64_t from = 0;
+
+			//txs still allowed in this page, empty for get_history which sends everything
+			std::optional<uint64_t> left;
+			uint64_t written = 0;
+
+			//the head of the response is sent
+			bool started = false;
+
+			//blockchain.scripthash.history, the result is a page with a resume token
+			bool paged = false;
+		};
+
 		class JsonRPCServer {
 		public:
 #ifndef ELECTRUMZ_NO_SSL
@@ -46,6 +72,7 @@ namespace electrumz {
 			int AppendBuffer(ssize_t, unsigned char*);
 			int WriteInternal(const ssize_t, const unsigned char*);
 			int WriteInternal(const nlohmann::json&);
+			int WriteAll(size_t, const unsigned char*);
 			bool IsTLSClientHello(ssize_t, char*);
 			int HandleCommand(nlohmann::json&&);
 
@@ -53,6 +80,13 @@ namespace electrumz {
 			int CommandSuccess(int id, const T&, nlohmann::json&);
 			int CommandError(int id, std::string, int, nlohmann::json&);
 
+			/**
+			 * Streams the history of a scriptHash straight from the db into the
+			 * socket, from the tx numbered from on
+			*/
+			int StartHistory(int id, const std::string& hash, uint64_t from, bool paged);
+			int WriteHistory();
+
 #ifndef ELECTRUMZ_NO_SSL
 			void InitTLSContext();
 			int TryHandshake();
@@ -75,6 +109,15 @@ namespace electrumz {
 			unsigned char *buf = nullptr;
 			ssize_t offset = 0;
 			ssize_t len = 0;
+
+			//commands that came in while a history is streamed, answered after it
+			HistoryStream history;
+			std::deque<nlohmann::json> queued;
+
+			//socket writes of history chunks not completed yet, the next chunk is
+			//read once they are all done. a chunk is tagged while it is written
+			uint32_t historyWrites = 0;
+			bool historyWriting = false;
 		};
 	}
 }
\ No newline at end of file
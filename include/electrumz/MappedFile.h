@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace electrumz {
+	namespace util {
+		enum class MapAccess {
+			Normal,
+			Sequential,
+			Random
+		};
+
+		/**
+		 * Read-only memory mapping of a whole file.
+		 * Pages are loaded by the kernel on first access and can be dropped
+		 * again under memory pressure, so mapping a file costs almost no RAM.
+		*/
+		class MappedFile {
+		public:
+			MappedFile() { }
+			~MappedFile();
+
+			// Disallow copies
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			/**
+			 * Maps the file at path, returns false if the file could not be mapped
+			*/
+			bool Open(const std::string& path);
+			void Close();
+
+			/**
+			 * Hint the expected access pattern to the kernel (madvise)
+			*/
+			void Advise(MapAccess access);
+
+			const unsigned char* data() const { return this->map; }
+			uint64_t size() const { return this->len; }
+		private:
+			unsigned char* map = nullptr;
+			uint64_t len = 0;
+#ifdef _WIN32
+			void* file = nullptr;
+			void* mapping = nullptr;
+#else
+			int fd = -1;
+#endif
+		};
+	}
+}
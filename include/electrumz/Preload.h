@@ -0,0 +1,188 @@
+#pragma once
+
+#include <electrumz/bitcoin/uint256.h>
+#include <electrumz/bitcoin/block.h>
+#include <electrumz/bitcoin/blockview.h>
+#include <electrumz/TXO.h>
+#include <electrumz/MappedFile.h>
+
+#include <vector>
+#include <memory>
+#include <string>
+
+namespace electrumz {
+	namespace blockchain {
+		/**
+		 * Thread counts and queue sizes for each stage of the preload pipeline.
+		 * Blocks flow read -> parse -> hash -> write, every stage runs on its own
+		 * threads and hands work to the next one through a bounded queue.
+		*/
+		class PreloadOptions {
+		public:
+			//threads reading blk files, one file per thread
+			uint32_t readThreads = 1;
+
+			//threads deserializing raw blocks
+			uint32_t parseThreads = 2;
+
+			//threads computing block and script hashes, 0 = one per core
+			uint32_t hashThreads = 0;
+
+			//max blocks waiting between two stages
+			uint32_t queueDepth = 64;
+
+			//the writer commits once either limit is reached
+			uint32_t commitBlocks = 500;
+			uint32_t commitMB = 256;
+
+			//unspent outputs kept in memory, outputs spent while cached are
+			//written once with their spend and never read back
+			uint32_t cacheOutputs = 2000000;
+
+			//read the rev*.dat undo file next to every blk file, spent outputs then
+			//come with the blocks. balances can't count spends of outputs that
+			//already left the cache without it, so preload fails when it is off
+			bool undo = true;
+
+			//build the outputs with an external sort and append them in key order,
+			//only allowed on an empty database
+			bool bulk = false;
+
+			//memory for the sort buffers and where sorted runs are spilled
+			uint32_t sortMB = 1024;
+			std::string sortDir;
+
+			//recompute the merkle root of every block and stop on a mismatch
+			bool checkMerkle = false;
+		};
+
+		class PreloadUndoFile;
+
+		/**
+		 * Where a block is stored, found by the header scan.
+		*/
+		class PreloadBlockPos {
+		public:
+			uint32_t file;
+			uint32_t size;
+			uint64_t offset;
+		};
+
+		/**
+		 * Serialized block inside a mapped blk file.
+		 * The mapping stays open until every block of the file is parsed.
+		*/
+		class RawBlock {
+		public:
+			std::shared_ptr<util::MappedFile> file;
+			const unsigned char* data = nullptr;
+			uint32_t size = 0;
+
+			//undo data of the blk file, if it is loaded
+			std::shared_ptr<PreloadUndoFile> undo;
+
+			uint32_t height = 0;
+		};
+
+		/**
+		 * Checked block waiting to be hashed, the view points into the mapped
+		 * blk file so the mapping is kept alive with it.
+		*/
+		class ParsedBlock {
+		public:
+			std::shared_ptr<util::MappedFile> file;
+			CBlockView block;
+			std::shared_ptr<PreloadUndoFile> undo;
+			uint32_t height = 0;
+			uint32_t size = 0;
+		};
+
+		/**
+		 * A block reduced to the records the writer stores, all hashing
+		 * is done before it reaches the writer.
+		*/
+		class IndexedBlock {
+		public:
+			uint256 hash;
+			CBlockHeader header;
+
+			//txids in block order
+			std::vector<uint256> txids;
+
+			//outputs in block order, grouped by txHash, txNum is the position
+			//of the tx in the block until the writer numbers the block
+			std::vector<TXO> outputs;
+
+			//prevout, spending input
+			std::vector<std::pair<COutPoint, COutPoint>> spends;
+
+			//the output each spend spends, from the undo data, empty when nothing is spent
+			std::vector<TXO> spentOutputs;
+
+			//position in the block of the tx of each spend
+			std::vector<uint32_t> spendTxs;
+
+			uint32_t ntx = 0;
+			uint32_t height = 0;
+
+			//serialized size of the block
+			uint32_t size = 0;
+		};
+
+		/**
+		 * A tx in the history of a scriptHash, paying it or spending from it.
+		*/
+		class PreloadHistoryTx {
+		public:
+			uint256 scriptHash;
+			uint256 txid;
+			uint64_t txNum;
+			uint32_t height;
+
+			//output index, or input index | TXORef::INPUT
+			uint32_t n;
+		};
+
+		/**
+		 * Records the writer stores in one txn.
+		*/
+		class PreloadBatch {
+		public:
+			std::vector<std::pair<uint256, CBlockHeader>> headers;
+
+			//txids numbered from firstTxNum on
+			std::vector<uint256> txids;
+			uint64_t firstTxNum = 0;
+
+			//height, txNum of the first tx of every block
+			std::vector<std::pair<uint32_t, uint64_t>> heights;
+
+			//outputs leaving the cache, spent or not
+			std::vector<TXO> outputs;
+
+			//spent outputs from the undo data, with their spend set
+			std::vector<TXO> spentOutputs;
+
+			//txs of the batch's blocks touching each scriptHash, in chain order,
+			//a tx shows up once for every output it pays or spends
+			std::vector<PreloadHistoryTx> history;
+
+			uint64_t bytes = 0;
+
+			//a blk file worth of blocks was written since the last sync
+			bool sync = false;
+
+			void clear() {
+				this->headers.clear();
+				this->txids.clear();
+				this->heights.clear();
+				this->firstTxNum = 0;
+				this->outputs.clear();
+				this->spentOutputs.clear();
+				this->history.clear();
+				this->bytes = 0;
+				this->sync = false;
+			}
+		};
+	}
+}
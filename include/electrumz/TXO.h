@@ -4,6 +4,13 @@
 #include <electrumz/bitcoin/amount.h>
 #include <electrumz/bitcoin/uint256.h>
 #include <electrumz/bitcoin/transaction.h>
+#include <electrumz/bitcoin/block.h>
+#include <electrumz/bitcoin/crypto_common.h>
+#include <electrumz/bitcoin/sha256.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
 
 namespace electrumz {
 	class TXO {
@@ -14,7 +21,7 @@ namespace electrumz {
 
 		//scriptHash, txHash, txIndex, value
 		TXO(uint256 sHash, uint256 txHash, uint32_t tIndex, CAmount v, uint64_t blockHeight)
-			: scriptHash(sHash), txHash(txHash), n(tIndex), value(v) {
+			: txHash(txHash), scriptHash(sHash), n(tIndex), value(v), height((uint32_t)blockHeight) {
 		}
 
 		ADD_SERIALIZE_METHODS;
@@ -23,17 +30,344 @@ namespace electrumz {
 		inline void SerializationOp(Stream& s, Operation ser_action) {
 			READWRITE(n);
 			READWRITE(value);
-			READWRITE(spend);
+			READWRITE(height);
 		}
 		
 		//in memory only
 		uint256 txHash;
 		uint256 scriptHash;
+		uint64_t txNum = 0;
+
+		//spending input, stored in DBI_SPEND, null while unspent
+		COutPoint spend;
 
 		uint32_t n;
 		CAmount value;
-		COutPoint spend;
+		uint32_t height = 0;
+	};
+
+	/**
+	 * Transactions are numbered in chain order from 0, a tx number is stored
+	 * as 5 big endian bytes so stored numbers sort in chain order.
+	*/
+	static constexpr size_t TXNUM_SIZE = 5;
+
+	//DBI_TXNUM value, the txid and the height of its block
+	static constexpr size_t TXNUM_RECORD_SIZE = 32 + 4;
+
+	inline void WriteTxNum(unsigned char* p, uint64_t txNum) {
+		for (size_t x = 0; x < TXNUM_SIZE; x++) {
+			p[x] = (unsigned char)(txNum >> (8 * (TXNUM_SIZE - 1 - x)));
+		}
+	}
+
+	inline uint64_t ReadTxNum(const unsigned char* p) {
+		uint64_t txNum = 0;
+		for (size_t x = 0; x < TXNUM_SIZE; x++) {
+			txNum = (txNum << 8) | p[x];
+		}
+		return txNum;
+	}
+
+	/**
+	 * An output by tx number instead of txid, what the addr index stores.
+	 * An input spending from the address is stored the same way with INPUT set in n.
+	*/
+	class TXORef {
+	public:
+		TXORef() { }
+		TXORef(uint64_t txNum, uint32_t n) : txNum(txNum), n(n) { }
+
+		//set in n of an input, inputs sort after the outputs of their tx
+		static constexpr uint32_t INPUT = 0x80000000;
+
+		uint64_t txNum = 0;
+		uint32_t n = 0;
+
+		bool IsInput() const {
+			return (this->n & INPUT) != 0;
+		}
+
+		bool operator<(const TXORef& b) const {
+			return this->txNum < b.txNum || (this->txNum == b.txNum && this->n < b.n);
+		}
+	};
+
+	/**
+	 * Fixed size encoding of a stored record, the same bytes its serializer writes.
+	 * Write fills a stack buffer or LMDB reserved memory directly, Read expects
+	 * at least Size bytes.
+	*/
+	template<typename T>
+	struct FixedCodec;
+
+	template<>
+	struct FixedCodec<COutPoint> {
+		//hash, n
+		static constexpr size_t Size = 32 + 4;
+
+		static void Write(unsigned char* p, const COutPoint& o) {
+			memcpy(p, o.hash.begin(), 32);
+			WriteLE32(p + 32, o.n);
+		}
+
+		static void Read(const unsigned char* p, COutPoint& o) {
+			memcpy(o.hash.begin(), p, 32);
+			o.n = ReadLE32(p + 32);
+		}
+	};
+
+	template<>
+	struct FixedCodec<TXORef> {
+		//txNum, n, both big endian so records sort in chain order
+		static constexpr size_t Size = TXNUM_SIZE + 4;
+
+		static void Write(unsigned char* p, const TXORef& r) {
+			WriteTxNum(p, r.txNum);
+			WriteBE32(p + TXNUM_SIZE, r.n);
+		}
+
+		static void Read(const unsigned char* p, TXORef& r) {
+			r.txNum = ReadTxNum(p);
+			r.n = ReadBE32(p + TXNUM_SIZE);
+		}
+	};
+
+	template<>
+	struct FixedCodec<TXO> {
+		//n, value, height
+		static constexpr size_t Size = 4 + 8 + 4;
+
+		static void Write(unsigned char* p, const TXO& t) {
+			WriteLE32(p, t.n);
+			WriteLE64(p + 4, (uint64_t)t.value);
+			WriteLE32(p + 12, t.height);
+		}
+
+		/// txHash, scriptHash and spend are not part of the record
+		static void Read(const unsigned char* p, TXO& t) {
+			t.n = ReadLE32(p);
+			t.value = (CAmount)ReadLE64(p + 4);
+			t.height = ReadLE32(p + 12);
+		}
+	};
+
+	/**
+	 * Running totals of a scriptHash, updated as blocks are stored so a balance
+	 * is one lookup. The same type holds the change a block makes, adding the
+	 * negated change takes the block out again.
+	*/
+	class AddrBalance {
+	public:
+		CAmount received = 0;
+		CAmount spent = 0;
+		int64_t utxos = 0;
+
+		void Receive(CAmount v) {
+			this->received += v;
+			this->utxos++;
+		}
+
+		void Spend(CAmount v) {
+			this->spent += v;
+			this->utxos--;
+		}
+
+		CAmount Confirmed() const {
+			return this->received - this->spent;
+		}
+
+		AddrBalance& operator+=(const AddrBalance& b) {
+			this->received += b.received;
+			this->spent += b.spent;
+			this->utxos += b.utxos;
+			return *this;
+		}
+
+		AddrBalance operator-() const {
+			AddrBalance b;
+			b.received = -this->received;
+			b.spent = -this->spent;
+			b.utxos = -this->utxos;
+			return b;
+		}
+	};
+
+	template<>
+	struct FixedCodec<AddrBalance> {
+		//received, spent, utxo count, signed so a change can be stored too
+		static constexpr size_t Size = 8 + 8 + 4;
+
+		static void Write(unsigned char* p, const AddrBalance& b) {
+			WriteLE64(p, (uint64_t)b.received);
+			WriteLE64(p + 8, (uint64_t)b.spent);
+			WriteLE32(p + 16, (uint32_t)(int32_t)b.utxos);
+		}
+
+		static void Read(const unsigned char* p, AddrBalance& b) {
+			b.received = (CAmount)ReadLE64(p);
+			b.spent = (CAmount)ReadLE64(p + 8);
+			b.utxos = (int32_t)ReadLE32(p + 16);
+		}
+	};
+
+	/**
+	 * Electrum status of a scriptHash, the sha256 of "txid:height:" for every tx
+	 * of its history in chain order. The sha256 state is stored between blocks,
+	 * so a block only hashes its own txs and the status is a finalize of a copy.
+	*/
+	class AddrStatus {
+	public:
+		static constexpr size_t MaxSize = CSHA256::MIDSTATE_MAX_SIZE;
+
+		/// Hashes the next tx of the history, mempool txs go after every confirmed one
+		void Append(const std::string& txid, int32_t height) {
+			auto entry = txid + ":" + std::to_string(height) + ":";
+			this->sha.Write((const unsigned char*)entry.data(), entry.size());
+			this->empty = false;
+		}
+
+		/// Electrum has no status for a scriptHash without history
+		bool Empty() const {
+			return this->empty;
+		}
+
+		uint256 Hash() const {
+			uint256 ret;
+			CSHA256(this->sha).Finalize(ret.begin());
+			return ret;
+		}
+
+		size_t Write(unsigned char* p) const {
+			return this->sha.SaveMidstate(p);
+		}
+
+		bool Read(const unsigned char* p, size_t len) {
+			this->empty = !this->sha.LoadMidstate(p, len);
+			return !this->empty;
+		}
+
+	private:
+		CSHA256 sha;
+		bool empty = true;
+	};
 
-		static const uint32_t ApproxSize = sizeof(n) + sizeof(value) + sizeof(spend);
+	/**
+	 * The outputs of an address are stored as a posting list, split in chunks of
+	 * up to ADDR_CHUNK_MAX refs in chain order. A chunk is keyed by the address
+	 * and its first ref, so a seek on (address, ref) lands on the chunk holding
+	 * that ref and the keys act as skip pointers into the list.
+	 * The first ref is only in the key, the value has the rest as varint deltas:
+	 * the txNum delta, then n, or n minus the previous n + 1 within the same tx.
+	*/
+	static constexpr size_t ADDR_CHUNK_MAX = 256;
+
+	struct TXORefChunk {
+		static void Encode(const TXORef* refs, size_t count, std::vector<unsigned char>& out) {
+			out.clear();
+			for (size_t x = 1; x < count; x++) {
+				uint64_t delta = refs[x].txNum - refs[x - 1].txNum;
+				WriteVarInt(out, delta);
+				WriteVarInt(out, delta == 0 ? refs[x].n - refs[x - 1].n - 1 : refs[x].n);
+			}
+		}
+
+		/// Appends the refs of a chunk to out, false if the value is cut short
+		static bool Decode(const TXORef& first, const unsigned char* p, size_t size, std::vector<TXORef>& out) {
+			const unsigned char* end = p + size;
+			TXORef ref = first;
+			out.push_back(ref);
+			while (p < end) {
+				uint64_t delta, n;
+				if (!ReadVarInt(p, end, delta) || !ReadVarInt(p, end, n)) {
+					return false;
+				}
+				ref.txNum += delta;
+				ref.n = (uint32_t)(delta == 0 ? ref.n + n + 1 : n);
+				out.push_back(ref);
+			}
+			return true;
+		}
+
+	private:
+		static void WriteVarInt(std::vector<unsigned char>& out, uint64_t v) {
+			while (v >= 0x80) {
+				out.push_back((unsigned char)(v | 0x80));
+				v >>= 7;
+			}
+			out.push_back((unsigned char)v);
+		}
+
+		static bool ReadVarInt(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+			//most deltas and indexes fit one byte
+			if (p < end && *p < 0x80) {
+				v = *p++;
+				return true;
+			}
+			v = 0;
+			for (int shift = 0; p < end && shift < 64; shift += 7) {
+				unsigned char b = *p++;
+				v |= (uint64_t)(b & 0x7f) << shift;
+				if (b < 0x80) {
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	/**
+	 * DBI_ADDR can be keyed by a scriptHash prefix, ADDR_KEY_MIN..ADDR_KEY_MAX bytes.
+	 * Prefixes can collide, so the txo records then keep the scriptHash bytes the
+	 * key leaves out and a query drops the outputs whose tail does not match.
+	 * Inputs then get a txo record of their own under the spending tx, keyed by
+	 * the input index with TXORef::INPUT set, so they are filtered the same way.
+	*/
+	static constexpr size_t ADDR_KEY_MIN = 8;
+	static constexpr size_t ADDR_KEY_MAX = 32;
+
+	//address key and the first ref of a chunk
+	static constexpr size_t ADDR_CHUNK_KEY_MAX = ADDR_KEY_MAX + FixedCodec<TXORef>::Size;
+
+	struct TXORecord {
+		//largest record, a TXO and the tail of an ADDR_KEY_MIN prefix
+		static constexpr size_t MaxSize = FixedCodec<TXO>::Size + ADDR_KEY_MAX - ADDR_KEY_MIN;
+
+		static size_t Size(size_t keyBytes) {
+			return FixedCodec<TXO>::Size + ADDR_KEY_MAX - keyBytes;
+		}
+
+		static void Write(unsigned char* p, const TXO& t, size_t keyBytes) {
+			FixedCodec<TXO>::Write(p, t);
+			memcpy(p + FixedCodec<TXO>::Size, t.scriptHash.begin() + keyBytes, ADDR_KEY_MAX - keyBytes);
+		}
+
+		static bool Matches(const unsigned char* p, const uint256& scriptHash, size_t keyBytes) {
+			return memcmp(p + FixedCodec<TXO>::Size, scriptHash.begin() + keyBytes, ADDR_KEY_MAX - keyBytes) == 0;
+		}
+	};
+
+	template<>
+	struct FixedCodec<CBlockHeader> {
+		//version, prev, merkle root, time, bits, nonce
+		static constexpr size_t Size = 4 + 32 + 32 + 4 + 4 + 4;
+
+		static void Write(unsigned char* p, const CBlockHeader& h) {
+			WriteLE32(p, (uint32_t)h.nVersion);
+			memcpy(p + 4, h.hashPrevBlock.begin(), 32);
+			memcpy(p + 36, h.hashMerkleRoot.begin(), 32);
+			WriteLE32(p + 68, h.nTime);
+			WriteLE32(p + 72, h.nBits);
+			WriteLE32(p + 76, h.nNonce);
+		}
+
+		static void Read(const unsigned char* p, CBlockHeader& h) {
+			h.nVersion = (int32_t)ReadLE32(p);
+			memcpy(h.hashPrevBlock.begin(), p + 4, 32);
+			memcpy(h.hashMerkleRoot.begin(), p + 36, 32);
+			h.nTime = ReadLE32(p + 68);
+			h.nBits = ReadLE32(p + 72);
+			h.nNonce = ReadLE32(p + 76);
+		}
 	};
 }
\ No newline at end of file
@@ -3,8 +3,13 @@
 #include <electrumz/bitcoin/uint256.h>
 #include <electrumz/bitcoin/block.h>
 #include <electrumz/TXO.h>
+#include <electrumz/Preload.h>
+#include <electrumz/ExternalSort.h>
 
 #include <vector>
+#include <map>
+#include <functional>
+#include <optional>
 #include <mutex>
 #include <string>
 #include <lmdb.h>
@@ -12,6 +17,12 @@
 #define DBI_TXO "txo"
 #define DBI_ADDR "addr"
 #define DBI_BLK "blk"
+#define DBI_TXNUM "txnum"
+#define DBI_ADDRID "addrid"
+#define DBI_HEIGHT "height"
+#define DBI_SPEND "spend"
+#define DBI_BALANCE "balance"
+#define DBI_STATUS "status"
 
 namespace electrumz {
 	namespace blockchain {
@@ -23,33 +34,191 @@ namespace electrumz {
 			TXO_MAP_FULL
 		};
 
+		/**
+		 * What BulkAppend does with the merged records
+		*/
+		enum class BulkRecords {
+			//stored as they are
+			Append,
+
+			//scriptHashes, each one stored once with the next address id
+			AddrIds,
+
+			//(address key, TXORef), packed into posting list chunks
+			Postings,
+
+			//(scriptHash, AddrBalance change), summed into one record per scriptHash
+			Balances,
+
+			//(scriptHash + txNum, txid + height), hashed into one status per scriptHash
+			Status
+		};
+
+		/**
+		 * Dup sort for DBI_TXO values
+		*/
+		int TXOCompare(const MDB_val*, const MDB_val*);
+
 		class TXODB {
 		public:
-			TXODB(std::string);
+			/**
+			 * addrKeyBytes is how much of a scriptHash keys DBI_ADDR in a new db,
+			 * an existing db keeps the key size it was created with
+			*/
+			TXODB(std::string, uint32_t addrKeyBytes = ADDR_KEY_MAX);
 			int Open();
 			char* GetLMDBVersion() { return mdb_version(NULL, NULL, NULL); }
-			void PreLoadBlocks(std::string);
+			void PreLoadBlocks(std::string, const PreloadOptions&);
 			
-			int GetTXOs(uint256, std::vector<TXO>&);
+			/**
+			 * Appends every output paid to a scriptHash from fromHeight on, spent or not,
+			 * in chain order (height, tx position, n). The list is read with one forward
+			 * scan from the first tx of fromHeight, so nothing is sorted in memory.
+			 * Returns TXO_NOTFOUND if the scriptHash has no outputs
+			*/
+			int GetTXOs(uint256, std::vector<TXO>&, uint32_t fromHeight = 0);
+
+			/**
+			 * Appends the unspent outputs of a scriptHash in chain order
+			*/
+			int GetUnspent(uint256, std::vector<TXO>&);
+
+			/**
+			 * Totals of a scriptHash from its DBI_BALANCE record, one lookup however
+			 * long the history is. Returns TXO_NOTFOUND for an address never paid
+			*/
+			int GetBalance(uint256, AddrBalance&);
+
+			/**
+			 * Stored status of the confirmed history of a scriptHash, mempool txs can
+			 * be appended to it. Returns TXO_NOTFOUND for an address without history
+			*/
+			int GetStatus(uint256, AddrStatus&);
+
+			/**
+			 * Calls f for up to max txs of the history of a scriptHash, every tx paying
+			 * or spending from it once, in chain order from the tx numbered from on.
+			 * Reads one posting list chunk at a time, nothing is collected. next is the
+			 * tx number to resume from, empty once the history is done
+			*/
+			int ReadHistory(uint256, uint64_t from, size_t max, const std::function<void(const uint256& txid, uint32_t height)>& f, std::optional<uint64_t>& next);
+
+			/**
+			 * Number of the first tx at or above a height, TXO_NOTFOUND above the tip
+			*/
+			int GetHeightTxNum(MDB_txn*, uint32_t height, uint64_t& txNum);
+
+			/**
+			 * Dense id of a scriptHash, ids count up from 0 without gaps so they can
+			 * index flat arrays and bitsets. Returns TXO_NOTFOUND for an address never paid
+			*/
+			int GetAddrId(const uint256&, uint32_t&);
 			int GetTXOStats(MDB_stat* stats, const char* dbn);
 		private:
 
 			std::string dbPath;
 			MDB_env *env;
+
+			//scriptHash bytes in a DBI_ADDR key, txo records keep the rest
+			uint32_t addrKeyBytes;
+
+			MDB_val AddrKey(const uint256& scriptHash) const {
+				return { this->addrKeyBytes, (void*)scriptHash.begin() };
+			}
+
+			/**
+			 * DBI_ADDR key of the chunk of a scriptHash that starts at first,
+			 * buf needs ADDR_CHUNK_KEY_MAX bytes
+			*/
+			MDB_val AddrChunkKey(unsigned char* buf, const uint256& scriptHash, const TXORef& first) const {
+				memcpy(buf, scriptHash.begin(), this->addrKeyBytes);
+				FixedCodec<TXORef>::Write(buf + this->addrKeyBytes, first);
+				return { this->addrKeyBytes + FixedCodec<TXORef>::Size, buf };
+			}
+
+			bool IsAddrChunk(const MDB_val& key, const uint256& scriptHash) const {
+				return key.mv_size == this->addrKeyBytes + FixedCodec<TXORef>::Size && memcmp(key.mv_data, scriptHash.begin(), this->addrKeyBytes) == 0;
+			}
+
+			/**
+			 * Moves the cursor to the chunk holding from, or the first chunk of
+			 * the scriptHash if from comes before it. MDB_NOTFOUND if there is no chunk
+			*/
+			int SeekAddrChunk(MDB_cursor*, const uint256&, const TXORef& from, MDB_val& key, MDB_val& val);
+
+			/**
+			 * Appends the refs of a scriptHash from a ref on, in chain order
+			*/
+			int ReadAddrRefs(MDB_txn*, const uint256&, const TXORef& from, std::vector<TXORef>&);
+
+			/**
+			 * Merges refs, sorted, into the posting list of a scriptHash
+			*/
+			int AddAddrRefs(MDB_txn*, const uint256&, const TXORef* refs, size_t count);
+
+			/**
+			 * Adds the changes to the balance records, in the txn that stores the block.
+			 * The negated changes of a block take it out again on a reorg
+			*/
+			int AddBalances(MDB_txn*, const std::map<uint256, AddrBalance>&);
+
+			/**
+			 * Hashes the txs into the stored status of their scriptHash. They must come
+			 * after every tx already hashed, a reorg needs the status hashed again
+			*/
+			int AppendStatus(MDB_txn*, const std::vector<PreloadHistoryTx>&);
 			std::mutex resize_lock;
 
+			//dbi handles, opened once in Open()
+			MDB_dbi dbi_txo;
+			MDB_dbi dbi_addr;
+			MDB_dbi dbi_blk;
+
+			//tx number -> txid and height, addr records point at txs by number
+			MDB_dbi dbi_txnum;
+
+			//full scriptHash -> uint32 address id
+			MDB_dbi dbi_addrid;
+
+			//block height -> number of its first tx, big endian so heights sort
+			MDB_dbi dbi_height;
+
+			//spent outpoint -> spending input, 36 -> 36 bytes, written once per spend
+			MDB_dbi dbi_spend;
+
+			//full scriptHash -> AddrBalance
+			MDB_dbi dbi_balance;
+
+			//full scriptHash -> sha256 state of its AddrStatus
+			MDB_dbi dbi_status;
+
 			/**
-			 * Appends a new UTXO to the database.
+			 * Stores the input spending prevout, the cursor must be on DBI_SPEND.
+			 * The output itself is not read, its txo record never changes
 			*/
-			int InternalAddTXO(TXO&, MDB_txn*, MDB_dbi&, MDB_dbi&);
-			
+			int InternalSpendTXO(MDB_cursor*, const COutPoint& prevout, const COutPoint& spendingTx);
+
 			/**
-			 * Marks an output as spent by txin.prevout
+			 * Sets the spend of txos[start..] by merge joining their outpoints,
+			 * in key order, against DBI_SPEND
 			*/
-			int InternalSpendTXO(COutPoint&, COutPoint&);
+			int JoinSpends(MDB_txn*, std::vector<TXO>&, size_t start);
 			int StartTXOTxn(MDB_txn**, const char*, MDB_dbi&);
+			int OpenDBIs();
 			int IncreaseMapSize();
 			int PushBlockTip(MDB_txn*, const CBlockHeader&);
+
+			/**
+			 * Preload writer stage, stores a batch in one txn
+			*/
+			int PreloadWriteBatch(const PreloadBatch&);
+
+			/**
+			 * Bulk preload, writes the merged runs of a sorter into an empty dbi
+			 * with MDB_APPEND, one txn per chunkBytes of records.
+			*/
+			int BulkAppend(util::ExternalSorter&, MDB_dbi, uint64_t chunkBytes, BulkRecords records = BulkRecords::Append);
+			int BulkAppendChunk(MDB_dbi, const std::vector<unsigned char>& chunk, std::vector<unsigned char>& lastKey, uint64_t& skipped);
 		};
 
 		template<typename Stream> inline void Serialize(Stream &s, MDB_val obj)
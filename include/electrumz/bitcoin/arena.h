@@ -0,0 +1,131 @@
+// Copyright (c) 2019 v0l
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ARENA_H
+#define BITCOIN_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Bump allocator for objects that all die together, like the transactions of one block.
+ * Nothing is freed one by one, Reset drops everything at once and keeps the memory
+ * for the next block.
+ *
+ * Containers using ArenaAllocator pick up the arena of the enclosing Arena::Scope
+ * when they are created, so a whole CBlock or CBlockUndo deserialized inside a
+ * scope lands in the arena without passing it down the serialization code.
+ * Everything allocated in the arena must be destroyed before Reset.
+ */
+class Arena
+{
+private:
+    std::vector<std::pair<char*, size_t>> m_chunks;
+    char* m_cur = nullptr;
+    char* m_end = nullptr;
+    size_t m_chunkSize;
+    size_t m_used = 0;
+
+    void* AllocateSlow(size_t size, size_t align);
+
+public:
+    explicit Arena(size_t chunkSize = 1024 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t align)
+    {
+        char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(m_cur) + align - 1) & ~(uintptr_t)(align - 1));
+        if (m_cur == nullptr || p + size > m_end) {
+            return AllocateSlow(size, align);
+        }
+        m_cur = p + size;
+        m_used += size;
+        return p;
+    }
+
+    /** Frees everything at once, the chunks are merged into one big enough for the last round. */
+    void Reset();
+
+    /** Bytes handed out since the last Reset. */
+    size_t Used() const { return m_used; }
+
+    /** The arena of the innermost Scope on this thread, nullptr outside of any scope. */
+    static Arena* Current();
+
+    /** Makes an arena the current one on this thread until the scope ends. */
+    class Scope
+    {
+    private:
+        Arena* m_prev;
+
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
+
+/**
+ * Allocates from an arena, or from the heap when there is none.
+ * A default constructed allocator uses Arena::Current(), copies of a container
+ * get a fresh default allocator, moves and swaps take the memory with its arena.
+ * Packed so it can be part of a packed prevector.
+ */
+#pragma pack(push, 1)
+template <typename T>
+class ArenaAllocator
+{
+private:
+    Arena* m_arena;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() noexcept : m_arena(Arena::Current()) {}
+    explicit ArenaAllocator(Arena* arena) noexcept : m_arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.arena()) {}
+
+    T* allocate(size_t n)
+    {
+        if (m_arena != nullptr) {
+            return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (m_arena == nullptr) {
+            std::allocator<T>().deallocate(p, n);
+        }
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    Arena* arena() const { return m_arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.arena(); }
+};
+#pragma pack(pop)
+
+template <typename T>
+using arena_vector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // BITCOIN_ARENA_H
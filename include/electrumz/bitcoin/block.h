@@ -75,8 +75,9 @@ public:
 class CBlock : public CBlockHeader
 {
 public:
-	// network and disk
-	std::vector<CTransactionRef> vtx;
+	// network and disk, deserialize inside an Arena::Scope to put the
+	// transactions, scripts and witnesses of the block in the arena
+	arena_vector<CTransactionRef> vtx;
 
 	// memory only
 	mutable bool fChecked;
@@ -0,0 +1,256 @@
+// Copyright (c) 2019 v0l
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PRIMITIVES_BLOCKVIEW_H
+#define BITCOIN_PRIMITIVES_BLOCKVIEW_H
+
+#include <electrumz/bitcoin/block.h>
+#include <electrumz/bitcoin/streams.h>
+#include <electrumz/bitcoin/crypto_common.h>
+
+#include <string.h>
+
+/**
+ * Reads memory that a SpanReader pass already checked, so there are no bounds checks.
+ * Has the part of the stream interface the view types use.
+ */
+class UncheckedReader
+{
+private:
+    const unsigned char* m_data;
+
+public:
+    explicit UncheckedReader(const unsigned char* data) : m_data(data) {}
+
+    const unsigned char* data() const { return m_data; }
+
+    void read(char* dst, size_t n)
+    {
+        memcpy(dst, m_data, n);
+        m_data += n;
+    }
+
+    void ignore(size_t n) { m_data += n; }
+};
+
+/** A transaction input inside a serialized block, nothing is copied. */
+class CTxInView
+{
+public:
+    /** 32 byte txid followed by the 4 byte output index */
+    const unsigned char* prevout = nullptr;
+    const unsigned char* scriptSig = nullptr;
+    size_t scriptSigSize = 0;
+    uint32_t nSequence = 0;
+
+    template <typename Reader>
+    void Read(Reader& r)
+    {
+        prevout = r.data();
+        r.ignore(36);
+        scriptSigSize = ReadCompactSize(r);
+        scriptSig = r.data();
+        r.ignore(scriptSigSize);
+        nSequence = ser_readdata32(r);
+    }
+
+    COutPoint GetPrevout() const
+    {
+        COutPoint out;
+        memcpy(out.hash.begin(), prevout, 32);
+        out.n = ReadLE32(prevout + 32);
+        return out;
+    }
+
+    bool IsCoinbase() const { return GetPrevout().IsNull(); }
+};
+
+/** A transaction output inside a serialized block, nothing is copied. */
+class CTxOutView
+{
+public:
+    CAmount nValue = 0;
+    const unsigned char* scriptPubKey = nullptr;
+    size_t scriptPubKeySize = 0;
+
+    template <typename Reader>
+    void Read(Reader& r)
+    {
+        nValue = (CAmount)ser_readdata64(r);
+        scriptPubKeySize = ReadCompactSize(r);
+        scriptPubKey = r.data();
+        r.ignore(scriptPubKeySize);
+    }
+};
+
+/** Items stored back to back in a buffer, each one is decoded when the iterator reaches it. */
+template <typename T>
+class CViewRange
+{
+private:
+    const unsigned char* m_begin;
+    size_t m_count;
+
+public:
+    class iterator
+    {
+    private:
+        UncheckedReader m_reader;
+        size_t m_left;
+        T m_cur;
+
+    public:
+        iterator(const unsigned char* data, size_t left) : m_reader(data), m_left(left)
+        {
+            if (m_left > 0) m_cur.Read(m_reader);
+        }
+
+        const T& operator*() const { return m_cur; }
+        const T* operator->() const { return &m_cur; }
+
+        iterator& operator++()
+        {
+            if (--m_left > 0) m_cur.Read(m_reader);
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return m_left == other.m_left; }
+        bool operator!=(const iterator& other) const { return m_left != other.m_left; }
+    };
+
+    CViewRange(const unsigned char* begin, size_t count) : m_begin(begin), m_count(count) {}
+
+    iterator begin() const { return iterator(m_begin, m_count); }
+    iterator end() const { return iterator(nullptr, 0); }
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+};
+
+/**
+ * A transaction inside a serialized block, nothing is copied.
+ * Inputs and outputs are decoded while iterating, the txid is hashed from the
+ * non-witness bytes in place.
+ */
+class CTransactionView
+{
+private:
+    const unsigned char* m_begin = nullptr;
+    const unsigned char* m_versionEnd = nullptr;
+    const unsigned char* m_vin = nullptr;
+    const unsigned char* m_vinData = nullptr;
+    const unsigned char* m_voutData = nullptr;
+    const unsigned char* m_voutEnd = nullptr;
+    const unsigned char* m_lockTime = nullptr;
+    const unsigned char* m_end = nullptr;
+    size_t m_nIn = 0;
+    size_t m_nOut = 0;
+    bool m_witness = false;
+
+public:
+    int32_t nVersion = 0;
+    uint32_t nLockTime = 0;
+
+    /** Same format as UnserializeTransaction, witnesses are always allowed. */
+    template <typename Reader>
+    void Read(Reader& r)
+    {
+        m_begin = r.data();
+        nVersion = (int32_t)ser_readdata32(r);
+        m_versionEnd = m_vin = r.data();
+
+        /* Try to read the vin. In case the dummy is there, this will be read as an empty vector. */
+        unsigned char flags = 0;
+        m_nIn = ReadCompactSize(r);
+        m_nOut = 0;
+        if (m_nIn == 0) {
+            /* We read a dummy or an empty vin. */
+            flags = ser_readdata8(r);
+            if (flags != 0) {
+                m_vin = r.data();
+                m_nIn = ReadCompactSize(r);
+                m_vinData = r.data();
+                SkipInputs(r);
+                m_nOut = ReadCompactSize(r);
+            }
+        } else {
+            m_vinData = r.data();
+            SkipInputs(r);
+            m_nOut = ReadCompactSize(r);
+        }
+        m_voutData = r.data();
+        CTxOutView out;
+        for (size_t i = 0; i < m_nOut; i++) {
+            out.Read(r);
+        }
+        m_voutEnd = r.data();
+
+        m_witness = (flags & 1) != 0;
+        if (m_witness) {
+            flags ^= 1;
+            for (size_t i = 0; i < m_nIn; i++) {
+                uint64_t items = ReadCompactSize(r);
+                for (uint64_t j = 0; j < items; j++) {
+                    r.ignore(ReadCompactSize(r));
+                }
+            }
+        }
+        if (flags) {
+            /* Unknown flag in the serialization */
+            throw std::ios_base::failure("Unknown transaction optional data");
+        }
+        m_lockTime = r.data();
+        nLockTime = ser_readdata32(r);
+        m_end = r.data();
+    }
+
+    CViewRange<CTxInView> Inputs() const { return CViewRange<CTxInView>(m_vinData, m_nIn); }
+    CViewRange<CTxOutView> Outputs() const { return CViewRange<CTxOutView>(m_voutData, m_nOut); }
+
+    size_t InputCount() const { return m_nIn; }
+    size_t OutputCount() const { return m_nOut; }
+    bool HasWitness() const { return m_witness; }
+
+    /** The serialized transaction, including witnesses. */
+    const unsigned char* data() const { return m_begin; }
+    size_t size() const { return m_end - m_begin; }
+
+    /** Compute the txid, the marker, flag and witness bytes are left out. */
+    uint256 GetHash() const;
+
+private:
+    template <typename Reader>
+    void SkipInputs(Reader& r)
+    {
+        CTxInView in;
+        for (size_t i = 0; i < m_nIn; i++) {
+            in.Read(r);
+        }
+    }
+};
+
+/**
+ * A read-only view of a serialized block, for walking the transactions
+ * without building a CBlock. The buffer must outlive the view.
+ */
+class CBlockView
+{
+private:
+    const unsigned char* m_data = nullptr;
+    const unsigned char* m_vtx = nullptr;
+    size_t m_ntx = 0;
+
+public:
+    CBlockHeader header;
+
+    /** Checks every transaction once, false if the block is truncated or malformed. */
+    bool Parse(const unsigned char* data, size_t size);
+
+    CViewRange<CTransactionView> Transactions() const { return CViewRange<CTransactionView>(m_vtx, m_ntx); }
+    size_t TransactionCount() const { return m_ntx; }
+
+    /** Hash of the 80 byte header as it is in the buffer. */
+    uint256 GetHash() const;
+};
+
+#endif // BITCOIN_PRIMITIVES_BLOCKVIEW_H
@@ -0,0 +1,90 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COMPRESSOR_H
+#define BITCOIN_COMPRESSOR_H
+
+#include <electrumz/bitcoin/transaction.h>
+#include <electrumz/bitcoin/script.h>
+#include <electrumz/bitcoin/serialize.h>
+
+#include <vector>
+
+uint64_t DecompressAmount(uint64_t nAmount);
+
+/** Compact serializer for scripts, read side only.
+ *
+ *  It detects common cases and encodes them much more efficiently.
+ *  3 special cases are defined:
+ *  * Pay to pubkey hash (encoded as 21 bytes)
+ *  * Pay to script hash (encoded as 21 bytes)
+ *  * Pay to pubkey starting with 0x02, 0x03 or 0x04 (encoded as 33 bytes)
+ *
+ *  Other scripts up to 121 bytes require 1 byte + script length. Above
+ *  that, scripts up to 16505 bytes require 2 bytes + script length.
+ */
+class CScriptCompressor
+{
+private:
+    /**
+     * make this static for now (there are only 6 special scripts defined)
+     * this can potentially be extended together with a new nVersion for
+     * transactions, in which case this value becomes dependent on nVersion
+     * and nHeight of the enclosing transaction.
+     */
+    static const unsigned int nSpecialScripts = 6;
+
+    CScript &script;
+protected:
+    unsigned int GetSpecialSize(unsigned int nSize) const;
+    bool Decompress(unsigned int nSize, const std::vector<unsigned char> &out);
+public:
+    explicit CScriptCompressor(CScript &scriptIn) : script(scriptIn) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nSize = 0;
+        s >> VARINT(nSize);
+        if (nSize < nSpecialScripts) {
+            std::vector<unsigned char> vch(GetSpecialSize(nSize), 0x00);
+            s.read((char*)vch.data(), vch.size());
+            if (!Decompress(nSize, vch)) {
+                throw std::ios_base::failure("CScriptCompressor: invalid special script");
+            }
+            return;
+        }
+        nSize -= nSpecialScripts;
+        if (nSize > MAX_SCRIPT_SIZE) {
+            // Overly long script, replace with a short invalid one
+            script.resize(1);
+            script[0] = OP_RETURN;
+            s.ignore(nSize);
+        } else {
+            script.resize(nSize);
+            s.read((char*)script.data(), nSize);
+        }
+    }
+};
+
+/** wrapper for CTxOut that provides a more compact serialization, read side only */
+class CTxOutCompressor
+{
+private:
+    CTxOut &txout;
+
+public:
+    explicit CTxOutCompressor(CTxOut &txoutIn) : txout(txoutIn) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        uint64_t nVal = 0;
+        s >> VARINT(nVal);
+        txout.nValue = DecompressAmount(nVal);
+        CScriptCompressor cscript(REF(txout.scriptPubKey));
+        s >> cscript;
+    }
+};
+
+#endif // BITCOIN_COMPRESSOR_H
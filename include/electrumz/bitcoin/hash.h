@@ -11,8 +11,8 @@
 #include <electrumz/bitcoin/uint256.h>
 #include <electrumz/bitcoin/crypto_common.h>
 #include <electrumz/bitcoin/prevector.h>
+#include <electrumz/bitcoin/sha256.h>
 
-#include <mbedtls/sha256.h>
 #include <mbedtls/ripemd160.h>
 
 static const size_t SHA256_OUTPUT_SIZE = 32;
@@ -20,30 +20,21 @@ static const size_t SHA256_OUTPUT_SIZE = 32;
 /** A hasher class for 256-bit hash (single SHA-256). */
 class CSHash256 {
 private:
-	mbedtls_sha256_context sha;
+	CSHA256 sha;
 public:
-	static const size_t OUTPUT_SIZE = 32;
-
-	CSHash256() {
-		mbedtls_sha256_init(&this->sha);
-		mbedtls_sha256_starts_ret(&this->sha, 0);
-	}
-
-	~CSHash256() {
-		mbedtls_sha256_free(&this->sha);
-	}
+	static const size_t OUTPUT_SIZE = CSHA256::OUTPUT_SIZE;
 
 	void Finalize(unsigned char hash[OUTPUT_SIZE]) {
-		mbedtls_sha256_finish_ret(&this->sha, hash);
+		this->sha.Finalize(hash);
 	}
 
 	CSHash256& Write(const unsigned char *data, size_t len) {
-		mbedtls_sha256_update_ret(&this->sha, data, len);
+		this->sha.Write(data, len);
 		return *this;
 	}
 
 	CSHash256& Reset() {
-		mbedtls_sha256_free(&this->sha);
+		this->sha.Reset();
 		return *this;
 	}
 };
@@ -51,37 +42,25 @@ public:
 /** A hasher class for Bitcoin's 256-bit hash (double SHA-256). */
 class CHash256 {
 private:
-	mbedtls_sha256_context sha;
+	CSHA256 sha;
 public:
-	static const size_t OUTPUT_SIZE = 32;
-
-	CHash256() {
-		mbedtls_sha256_init(&this->sha);
-		mbedtls_sha256_starts_ret(&this->sha, 0);
-	}
-
-	~CHash256() {
-		mbedtls_sha256_free(&this->sha);
-	}
+	static const size_t OUTPUT_SIZE = CSHA256::OUTPUT_SIZE;
 
 	void Finalize(unsigned char hash[OUTPUT_SIZE]) {
 		unsigned char buf[OUTPUT_SIZE];
-		mbedtls_sha256_finish_ret(&this->sha, buf);
-		
+		this->sha.Finalize(buf);
+
 		//so second round
-		mbedtls_sha256_free(&this->sha);
-		mbedtls_sha256_starts_ret(&this->sha, 0);
-		mbedtls_sha256_update_ret(&this->sha, buf, OUTPUT_SIZE);
-		mbedtls_sha256_finish_ret(&this->sha, hash);
+		this->sha.Reset().Write(buf, OUTPUT_SIZE).Finalize(hash);
 	}
 
 	CHash256& Write(const unsigned char *data, size_t len) {
-		mbedtls_sha256_update_ret(&this->sha, data, len);
+		this->sha.Write(data, len);
 		return *this;
 	}
 
 	CHash256& Reset() {
-		mbedtls_sha256_free(&this->sha);
+		this->sha.Reset();
 		return *this;
 	}
 };
@@ -89,39 +68,35 @@ public:
 /** A hasher class for Bitcoin's 160-bit hash (SHA-256 + RIPEMD-160). */
 class CHash160 {
 private:
-	mbedtls_sha256_context sha_ctx;
+	CSHA256 sha_ctx;
 	mbedtls_ripemd160_context ctx;
 public:
 	static const size_t OUTPUT_SIZE = 20;
 
 	CHash160() {
-		mbedtls_sha256_init(&this->sha_ctx);
-		mbedtls_sha256_starts_ret(&this->sha_ctx, 0);
-
 		mbedtls_ripemd160_init(&this->ctx);
 		mbedtls_ripemd160_starts_ret(&this->ctx);
 	}
 
 	~CHash160() {
-		mbedtls_sha256_free(&this->sha_ctx);
 		mbedtls_ripemd160_free(&this->ctx);
 	}
 
 	void Finalize(unsigned char hash[OUTPUT_SIZE]) {
 		unsigned char buf[CHash256::OUTPUT_SIZE];
 
-		mbedtls_sha256_finish_ret(&this->sha_ctx, buf);
+		this->sha_ctx.Finalize(buf);
 		mbedtls_ripemd160_update(&this->ctx, buf, CHash256::OUTPUT_SIZE);
 		mbedtls_ripemd160_finish_ret(&this->ctx, hash);
 	}
 
 	CHash160& Write(const unsigned char *data, size_t len) {
-		mbedtls_sha256_update_ret(&this->sha_ctx, data, len);
+		this->sha_ctx.Write(data, len);
 		return *this;
 	}
 
 	CHash160& Reset() {
-		mbedtls_sha256_free(&this->sha_ctx);
+		this->sha_ctx.Reset();
 		mbedtls_ripemd160_free(&this->ctx);
 		return *this;
 	}
@@ -138,6 +113,16 @@ inline uint256 SHash(const T1 pbegin, const T1 pend)
 	return result;
 }
 
+/**
+ * Compute the 256-bit hash of count independent objects at once, out[i] = SHash(in[i], in[i] + len[i]).
+ * Use this over SHash when there are many short objects, like every scriptPubKey of a block.
+ */
+inline void SHashBatch(uint256* out, const unsigned char* const* in, const size_t* len, size_t count)
+{
+	static_assert(sizeof(uint256) == CSHA256::OUTPUT_SIZE, "uint256 must be tightly packed");
+	SHA256Batch((unsigned char*)out, in, len, count);
+}
+
 /** Compute the 256-bit hash of an object. */
 template<typename T1>
 inline uint256 Hash(const T1 pbegin, const T1 pend)
@@ -179,8 +164,8 @@ inline uint160 Hash160(const std::vector<unsigned char>& vch)
 }
 
 /** Compute the 160-bit hash of a vector. */
-template<unsigned int N>
-inline uint160 Hash160(const prevector<N, unsigned char>& vch)
+template<unsigned int N, typename A>
+inline uint160 Hash160(const prevector<N, unsigned char, uint32_t, int32_t, A>& vch)
 {
 	return Hash160(vch.begin(), vch.end());
 }
@@ -0,0 +1,33 @@
+// Copyright (c) 2015-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CONSENSUS_MERKLE_H
+#define BITCOIN_CONSENSUS_MERKLE_H
+
+#include <electrumz/bitcoin/block.h>
+#include <electrumz/bitcoin/uint256.h>
+
+#include <stdint.h>
+#include <vector>
+
+/** Compute the merkle root of a list of hashes, mutated is set if two hashes of one level are equal (CVE-2012-2459). */
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
+
+/**
+ * Compute the merkle branch of the hash at position, the sibling on every level from the bottom up.
+ * This is the "merkle" list of blockchain.transaction.get_merkle and the cp_height header proofs.
+ * Returns false and leaves branch empty if position is not in hashes, it can come from a client.
+ */
+bool ComputeMerkleBranch(std::vector<uint256> hashes, uint32_t position, std::vector<uint256>& branch);
+
+/** Compute the merkle root from a leaf and its branch. */
+uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
+
+/*
+ * Compute the Merkle root of the transactions in a block.
+ * *mutated is set to true if a duplicated subtree was found.
+ */
+uint256 BlockMerkleRoot(const CBlock& block, bool* mutated = nullptr);
+
+#endif // BITCOIN_CONSENSUS_MERKLE_H
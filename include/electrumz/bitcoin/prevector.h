@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <iterator>
+#include <memory>
 #include <type_traits>
 
 #pragma pack(push, 1)
@@ -33,9 +34,13 @@
  *
  *  The data type T must be movable by memmove/realloc(). Once we switch to C++,
  *  move constructors can be used instead.
+ *
+ *  The indirect array comes from Alloc, a byte allocator. A default constructed
+ *  prevector uses a default constructed Alloc, copies too, moves and swaps take
+ *  the array along with the allocator it came from.
  */
-template<unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
-class prevector {
+template<unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t, typename Alloc = std::allocator<char>>
+class prevector : private Alloc {
 public:
     typedef Size size_type;
     typedef Diff difference_type;
@@ -168,21 +173,20 @@ private:
                 T* indirect = indirect_ptr(0);
                 T* src = indirect;
                 T* dst = direct_ptr(0);
+                size_type capacity = _union.capacity;
                 memcpy(dst, src, size() * sizeof(T));
-                free(indirect);
+                Alloc::deallocate(reinterpret_cast<char*>(indirect), ((size_t)sizeof(T)) * capacity);
                 _size -= N + 1;
             }
         } else {
             if (!is_direct()) {
-                /* FIXME: Because malloc/realloc here won't call new_handler if allocation fails, assert
-                    success. These should instead use an allocator or new/delete so that handlers
-                    are called as necessary, but performance would be slightly degraded by doing so. */
-                _union.indirect = static_cast<char*>(realloc(_union.indirect, ((size_t)sizeof(T)) * new_capacity));
-                assert(_union.indirect);
+                char* new_indirect = Alloc::allocate(((size_t)sizeof(T)) * new_capacity);
+                memcpy(new_indirect, _union.indirect, size() * sizeof(T));
+                Alloc::deallocate(_union.indirect, ((size_t)sizeof(T)) * _union.capacity);
+                _union.indirect = new_indirect;
                 _union.capacity = new_capacity;
             } else {
-                char* new_indirect = static_cast<char*>(malloc(((size_t)sizeof(T)) * new_capacity));
-                assert(new_indirect);
+                char* new_indirect = Alloc::allocate(((size_t)sizeof(T)) * new_capacity);
                 T* src = direct_ptr(0);
                 T* dst = reinterpret_cast<T*>(new_indirect);
                 memcpy(dst, src, size() * sizeof(T));
@@ -250,18 +254,18 @@ public:
         fill(item_ptr(0), first, last);
     }
 
-    prevector(const prevector<N, T, Size, Diff>& other) : prevector() {
+    prevector(const prevector& other) : prevector() {
         size_type n = other.size();
         change_capacity(n);
         _size += n;
         fill(item_ptr(0), other.begin(),  other.end());
     }
 
-    prevector(prevector<N, T, Size, Diff>&& other) : prevector() {
+    prevector(prevector&& other) : prevector() {
         swap(other);
     }
 
-    prevector& operator=(const prevector<N, T, Size, Diff>& other) {
+    prevector& operator=(const prevector& other) {
         if (&other == this) {
             return *this;
         }
@@ -269,7 +273,7 @@ public:
         return *this;
     }
 
-    prevector& operator=(prevector<N, T, Size, Diff>&& other) {
+    prevector& operator=(prevector&& other) {
         swap(other);
         return *this;
     }
@@ -433,7 +437,8 @@ public:
         return *item_ptr(size() - 1);
     }
 
-    void swap(prevector<N, T, Size, Diff>& other) {
+    void swap(prevector& other) {
+        std::swap(static_cast<Alloc&>(*this), static_cast<Alloc&>(other));
         std::swap(_union, other._union);
         std::swap(_size, other._size);
     }
@@ -443,12 +448,12 @@ public:
             clear();
         }
         if (!is_direct()) {
-            free(_union.indirect);
+            Alloc::deallocate(_union.indirect, ((size_t)sizeof(T)) * _union.capacity);
             _union.indirect = nullptr;
         }
     }
 
-    bool operator==(const prevector<N, T, Size, Diff>& other) const {
+    bool operator==(const prevector& other) const {
         if (other.size() != size()) {
             return false;
         }
@@ -465,11 +470,11 @@ public:
         return true;
     }
 
-    bool operator!=(const prevector<N, T, Size, Diff>& other) const {
+    bool operator!=(const prevector& other) const {
         return !(*this == other);
     }
 
-    bool operator<(const prevector<N, T, Size, Diff>& other) const {
+    bool operator<(const prevector& other) const {
         if (size() < other.size()) {
             return true;
         }
@@ -9,6 +9,7 @@
 
 
 #include <variant>
+#include <electrumz/bitcoin/arena.h>
 #include <electrumz/bitcoin/prevector.h>
 #include <electrumz/bitcoin/serialize.h>
 #include <electrumz/bitcoin/hash.h>
@@ -237,7 +238,7 @@ struct WitnessUnknown
 	}
 };
 
-typedef prevector<28, unsigned char> CScriptBase;
+typedef prevector<28, unsigned char, uint32_t, int32_t, ArenaAllocator<char>> CScriptBase;
 typedef std::vector<unsigned char> valtype;
 typedef std::variant<CNoDestination, CKeyID, CScriptID, WitnessV0ScriptHash, WitnessV0KeyHash, WitnessUnknown> CTxDestination;
 
@@ -317,7 +318,7 @@ struct CScriptWitness
 {
 	// Note that this encodes the data elements being pushed, rather than
 	// encoding them as a CScript that pushes them.
-	std::vector<std::vector<unsigned char> > stack;
+	arena_vector<arena_vector<unsigned char> > stack;
 
 	// Some compilers complain without a default constructor
 	CScriptWitness() { }
@@ -7,6 +7,7 @@
 #define BITCOIN_SERIALIZE_H
 
 #include <electrumz/bitcoin/comapt_endian.h>
+#include <electrumz/bitcoin/arena.h>
 #include <electrumz/bitcoin/prevector.h>
 
 #include <algorithm>
@@ -19,6 +20,7 @@
 #include <stdint.h>
 #include <string>
 #include <string.h>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -522,26 +524,52 @@ BigEndian<I> WrapBigEndian(I& n) { return BigEndian<I>(n); }
 template<typename Stream, typename C> void Serialize(Stream& os, const std::basic_string<C>& str);
 template<typename Stream, typename C> void Unserialize(Stream& is, std::basic_string<C>& str);
 
+/**
+ * Element types whose serialized bytes are their bytes in memory, containers of
+ * them are read and written as one block instead of element by element.
+ * Fixed width integers qualify on little endian hosts only, bool never does as
+ * any byte read into it would have to be a valid bool.
+ */
+#if defined(WORDS_BIGENDIAN) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+static constexpr bool SER_LITTLE_ENDIAN = false;
+#else
+static constexpr bool SER_LITTLE_ENDIAN = true;
+#endif
+
+template<typename T> struct is_trivially_serializable : std::false_type {};
+template<> struct is_trivially_serializable<char> : std::true_type {};
+template<> struct is_trivially_serializable<signed char> : std::true_type {};
+template<> struct is_trivially_serializable<unsigned char> : std::true_type {};
+template<> struct is_trivially_serializable<int16_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+template<> struct is_trivially_serializable<uint16_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+template<> struct is_trivially_serializable<int32_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+template<> struct is_trivially_serializable<uint32_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+template<> struct is_trivially_serializable<int64_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+template<> struct is_trivially_serializable<uint64_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN> {};
+
+template<typename T>
+using ser_blob_tag = std::integral_constant<bool, is_trivially_serializable<T>::value>;
+
 /**
  * prevector
- * prevectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
+ * prevectors of trivially serializable types are a special case and are serialized as a single opaque blob.
  */
-template<typename Stream, unsigned int N, typename T> void Serialize_impl(Stream& os, const prevector<N, T>& v, const unsigned char&);
-template<typename Stream, unsigned int N, typename T, typename V> void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&);
-template<typename Stream, unsigned int N, typename T> inline void Serialize(Stream& os, const prevector<N, T>& v);
-template<typename Stream, unsigned int N, typename T> void Unserialize_impl(Stream& is, prevector<N, T>& v, const unsigned char&);
-template<typename Stream, unsigned int N, typename T, typename V> void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&);
-template<typename Stream, unsigned int N, typename T> inline void Unserialize(Stream& is, prevector<N, T>& v);
+template<typename Stream, unsigned int N, typename T, typename A> void Serialize_impl(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v, std::true_type);
+template<typename Stream, unsigned int N, typename T, typename A> void Serialize_impl(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v, std::false_type);
+template<typename Stream, unsigned int N, typename T, typename A> inline void Serialize(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v);
+template<typename Stream, unsigned int N, typename T, typename A> void Unserialize_impl(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v, std::true_type);
+template<typename Stream, unsigned int N, typename T, typename A> void Unserialize_impl(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v, std::false_type);
+template<typename Stream, unsigned int N, typename T, typename A> inline void Unserialize(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v);
 
 /**
  * vector
- * vectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
+ * vectors of trivially serializable types are a special case and are serialized as a single opaque blob.
  */
-template<typename Stream, typename T, typename A> void Serialize_impl(Stream& os, const std::vector<T, A>& v, const unsigned char&);
-template<typename Stream, typename T, typename A, typename V> void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&);
+template<typename Stream, typename T, typename A> void Serialize_impl(Stream& os, const std::vector<T, A>& v, std::true_type);
+template<typename Stream, typename T, typename A> void Serialize_impl(Stream& os, const std::vector<T, A>& v, std::false_type);
 template<typename Stream, typename T, typename A> inline void Serialize(Stream& os, const std::vector<T, A>& v);
-template<typename Stream, typename T, typename A> void Unserialize_impl(Stream& is, std::vector<T, A>& v, const unsigned char&);
-template<typename Stream, typename T, typename A, typename V> void Unserialize_impl(Stream& is, std::vector<T, A>& v, const V&);
+template<typename Stream, typename T, typename A> void Unserialize_impl(Stream& is, std::vector<T, A>& v, std::true_type);
+template<typename Stream, typename T, typename A> void Unserialize_impl(Stream& is, std::vector<T, A>& v, std::false_type);
 template<typename Stream, typename T, typename A> inline void Unserialize(Stream& is, std::vector<T, A>& v);
 
 /**
@@ -620,31 +648,31 @@ void Unserialize(Stream& is, std::basic_string<C>& str)
 /**
  * prevector
  */
-template<typename Stream, unsigned int N, typename T>
-void Serialize_impl(Stream& os, const prevector<N, T>& v, const unsigned char&)
+template<typename Stream, unsigned int N, typename T, typename A>
+void Serialize_impl(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v, std::true_type)
 {
     WriteCompactSize(os, v.size());
     if (!v.empty())
         os.write((char*)v.data(), v.size() * sizeof(T));
 }
 
-template<typename Stream, unsigned int N, typename T, typename V>
-void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&)
+template<typename Stream, unsigned int N, typename T, typename A>
+void Serialize_impl(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v, std::false_type)
 {
     WriteCompactSize(os, v.size());
-    for (typename prevector<N, T>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
+    for (typename prevector<N, T, uint32_t, int32_t, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
         ::Serialize(os, (*vi));
 }
 
-template<typename Stream, unsigned int N, typename T>
-inline void Serialize(Stream& os, const prevector<N, T>& v)
+template<typename Stream, unsigned int N, typename T, typename A>
+inline void Serialize(Stream& os, const prevector<N, T, uint32_t, int32_t, A>& v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, ser_blob_tag<T>());
 }
 
 
-template<typename Stream, unsigned int N, typename T>
-void Unserialize_impl(Stream& is, prevector<N, T>& v, const unsigned char&)
+template<typename Stream, unsigned int N, typename T, typename A>
+void Unserialize_impl(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v, std::true_type)
 {
     // Limit size per read so bogus size value won't cause out of memory
     v.clear();
@@ -659,8 +687,8 @@ void Unserialize_impl(Stream& is, prevector<N, T>& v, const unsigned char&)
     }
 }
 
-template<typename Stream, unsigned int N, typename T, typename V>
-void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&)
+template<typename Stream, unsigned int N, typename T, typename A>
+void Unserialize_impl(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v, std::false_type)
 {
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -677,10 +705,10 @@ void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&)
     }
 }
 
-template<typename Stream, unsigned int N, typename T>
-inline void Unserialize(Stream& is, prevector<N, T>& v)
+template<typename Stream, unsigned int N, typename T, typename A>
+inline void Unserialize(Stream& is, prevector<N, T, uint32_t, int32_t, A>& v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, ser_blob_tag<T>());
 }
 
 
@@ -689,15 +717,15 @@ inline void Unserialize(Stream& is, prevector<N, T>& v)
  * vector
  */
 template<typename Stream, typename T, typename A>
-void Serialize_impl(Stream& os, const std::vector<T, A>& v, const unsigned char&)
+void Serialize_impl(Stream& os, const std::vector<T, A>& v, std::true_type)
 {
     WriteCompactSize(os, v.size());
     if (!v.empty())
         os.write((char*)v.data(), v.size() * sizeof(T));
 }
 
-template<typename Stream, typename T, typename A, typename V>
-void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&)
+template<typename Stream, typename T, typename A>
+void Serialize_impl(Stream& os, const std::vector<T, A>& v, std::false_type)
 {
     WriteCompactSize(os, v.size());
     for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
@@ -707,12 +735,12 @@ void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&)
 template<typename Stream, typename T, typename A>
 inline void Serialize(Stream& os, const std::vector<T, A>& v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, ser_blob_tag<T>());
 }
 
 
 template<typename Stream, typename T, typename A>
-void Unserialize_impl(Stream& is, std::vector<T, A>& v, const unsigned char&)
+void Unserialize_impl(Stream& is, std::vector<T, A>& v, std::true_type)
 {
     // Limit size per read so bogus size value won't cause out of memory
     v.clear();
@@ -727,8 +755,8 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, const unsigned char&)
     }
 }
 
-template<typename Stream, typename T, typename A, typename V>
-void Unserialize_impl(Stream& is, std::vector<T, A>& v, const V&)
+template<typename Stream, typename T, typename A>
+void Unserialize_impl(Stream& is, std::vector<T, A>& v, std::false_type)
 {
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -748,7 +776,7 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, const V&)
 template<typename Stream, typename T, typename A>
 inline void Unserialize(Stream& is, std::vector<T, A>& v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, ser_blob_tag<T>());
 }
 
 
@@ -855,7 +883,7 @@ Serialize(Stream& os, const std::shared_ptr<const T>& p)
 template<typename Stream, typename T>
 void Unserialize(Stream& is, std::shared_ptr<const T>& p)
 {
-    p = std::make_shared<const T>(deserialize, is);
+    p = std::allocate_shared<const T>(ArenaAllocator<T>(), deserialize, is);
 }
 
 
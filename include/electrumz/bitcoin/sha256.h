@@ -0,0 +1,57 @@
+// Copyright (c) 2014-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_H
+#define BITCOIN_CRYPTO_SHA256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for SHA-256. */
+class CSHA256
+{
+private:
+    uint32_t s[8];
+    unsigned char buf[64];
+    uint64_t bytes;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    /** Byte count, state words and the buffered bytes of an unfinished block. */
+    static const size_t MIDSTATE_MAX_SIZE = 8 + 32 + 63;
+
+    CSHA256();
+    CSHA256& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CSHA256& Reset();
+
+    /** Serializes the state so more data can be written later, returns the bytes used. */
+    size_t SaveMidstate(unsigned char out[MIDSTATE_MAX_SIZE]) const;
+
+    /** Restores a state written by SaveMidstate, false if in does not hold one. */
+    bool LoadMidstate(const unsigned char* in, size_t len);
+};
+
+/** Autodetect the best available SHA256 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  output may be the same buffer as input, each hash is written after its input is read.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute SHA-256 of n independent messages, out[i * 32] = SHA256(in[i], len[i]).
+ *  Messages are spread over the SIMD lanes picked by SHA256AutoDetect, this is
+ *  much faster than hashing short messages one at a time.
+ */
+void SHA256Batch(unsigned char* out, const unsigned char* const* in, const size_t* len, size_t n);
+
+#endif // BITCOIN_CRYPTO_SHA256_H
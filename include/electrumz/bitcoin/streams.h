@@ -195,6 +195,72 @@ public:
     }
 };
 
+/** Minimal stream for reading from memory that is owned elsewhere (eg. a mapped file)
+ */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+
+public:
+
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Start of the memory to read, must outlive this reader
+     * @param[in]  size Number of bytes that can be read
+     */
+    SpanReader(int type, int version, const unsigned char* data, size_t size)
+        : m_type(type), m_version(version), m_data(data), m_size(size) { }
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_size - m_pos; }
+    bool empty() const { return m_size == m_pos; }
+
+    //! return the current reading position
+    size_t GetPos() const { return m_pos; }
+
+    //! pointer to the next unread byte
+    const unsigned char* data() const { return m_data + m_pos; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+
+        size_t pos_next = m_pos + n;
+        if (pos_next > m_size) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data + m_pos, n);
+        m_pos = pos_next;
+    }
+
+    void ignore(size_t n)
+    {
+        size_t pos_next = m_pos + n;
+        if (pos_next > m_size) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_pos = pos_next;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -12,6 +12,8 @@
 #include <electrumz/bitcoin/serialize.h>
 #include <electrumz/bitcoin/uint256.h>
 
+class SpanReader;
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
@@ -280,19 +282,23 @@ public:
     // actually immutable; deserialization and assignment are implemented,
     // and bypass the constness. This is safe, as they update the entire
     // structure, including the hash.
-    const std::vector<CTxIn> vin;
-    const std::vector<CTxOut> vout;
+    const arena_vector<CTxIn> vin;
+    const arena_vector<CTxOut> vout;
     const int32_t nVersion;
     const uint32_t nLockTime;
 
 private:
     /** Memory only. */
     const uint256 hash;
-    const uint256 m_witness_hash;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    /** A transaction read from a byte buffer together with its txid. */
+    struct Hashed;
+    static Hashed UnserializeHashed(SpanReader& s);
+    CTransaction(Hashed&& tx);
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -311,12 +317,17 @@ public:
     template <typename Stream>
     CTransaction(deserialize_type, Stream& s) : CTransaction(CMutableTransaction(deserialize, s)) {}
 
+    /** Deserialize from a byte buffer (a block), the txid is hashed from the
+     *  non-witness bytes of the buffer instead of serializing the transaction again. */
+    CTransaction(deserialize_type, SpanReader& s);
+
     bool IsNull() const {
         return vin.empty() && vout.empty();
     }
 
     const uint256& GetHash() const { return hash; }
-    const uint256& GetWitnessHash() const { return m_witness_hash; };
+    /** Not cached, the indexer only needs txids. */
+    uint256 GetWitnessHash() const { return ComputeWitnessHash(); };
 
     // Return sum of txouts.
     CAmount GetValueOut() const;
@@ -361,8 +372,8 @@ public:
 /** A mutable version of CTransaction. */
 struct CMutableTransaction
 {
-    std::vector<CTxIn> vin;
-    std::vector<CTxOut> vout;
+    arena_vector<CTxIn> vin;
+    arena_vector<CTxOut> vout;
     int32_t nVersion;
     uint32_t nLockTime;
 
@@ -402,7 +413,7 @@ struct CMutableTransaction
 };
 
 typedef std::shared_ptr<const CTransaction> CTransactionRef;
-static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
-template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+static inline CTransactionRef MakeTransactionRef() { return std::allocate_shared<const CTransaction>(ArenaAllocator<CTransaction>()); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::allocate_shared<const CTransaction>(ArenaAllocator<CTransaction>(), std::forward<Tx>(txIn)); }
 
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
\ No newline at end of file
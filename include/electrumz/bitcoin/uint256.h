@@ -11,6 +11,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 /** Template base class for fixed-sized opaque blobs. */
@@ -124,6 +125,11 @@ public:
     explicit uint256(const std::vector<unsigned char>& vch) : base_blob<256>(vch) {}
 };
 
+/** Blobs serialize as their raw bytes, so vectors of them are copied in one block (see serialize.h). */
+template<typename T> struct is_trivially_serializable;
+template<> struct is_trivially_serializable<uint160> : std::integral_constant<bool, sizeof(uint160) == 20> {};
+template<> struct is_trivially_serializable<uint256> : std::integral_constant<bool, sizeof(uint256) == 32> {};
+
 /* uint256 from const char *.
  * This is a separate function because the constructor uint256(const char*) can result
  * in dangerously catching uint256(0).
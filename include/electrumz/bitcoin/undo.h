@@ -0,0 +1,97 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UNDO_H
+#define BITCOIN_UNDO_H
+
+#include <electrumz/bitcoin/compressor.h>
+#include <electrumz/bitcoin/transaction.h>
+#include <electrumz/bitcoin/serialize.h>
+
+#include <vector>
+
+/** A spent output as stored in the undo data (coins.h Coin) */
+class Coin
+{
+public:
+    //! unspent transaction output
+    CTxOut out;
+
+    //! whether containing transaction was a coinbase
+    bool fCoinBase = false;
+
+    //! at which height this containing transaction was included in the active block chain
+    uint32_t nHeight = 0;
+};
+
+/** Formatter for undo information for a CTxIn
+ *
+ *  Contains the prevout's CTxOut being spent, and its metadata as well
+ *  (coinbase or not, height). The serialization contains a dummy value of
+ *  zero. This is compatible with older versions which expect to see
+ *  the transaction version there.
+ */
+class TxInUndoDeserializer
+{
+    Coin* txout;
+
+public:
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        txout->nHeight = nCode / 2;
+        txout->fCoinBase = nCode & 1;
+        if (txout->nHeight > 0) {
+            // Old versions stored the version number for the last spend of
+            // a transaction's outputs. Non-final spends were indicated with
+            // height = 0.
+            unsigned int nVersionDummy;
+            ::Unserialize(s, VARINT(nVersionDummy));
+        }
+        ::Unserialize(s, CTxOutCompressor(REF(txout->out)));
+    }
+
+    explicit TxInUndoDeserializer(Coin* coin) : txout(coin) {}
+};
+
+// smallest possible txin is 41 bytes, at 4 weight units per byte
+static const size_t MAX_INPUTS_PER_BLOCK = 4000000 / (4 * 41);
+
+/** Undo information for a CTransaction */
+class CTxUndo
+{
+public:
+    // undo information for all txins
+    arena_vector<Coin> vprevout;
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        // TODO: avoid reimplementing vector deserializer
+        uint64_t count = 0;
+        ::Unserialize(s, COMPACTSIZE(count));
+        if (count > MAX_INPUTS_PER_BLOCK) {
+            throw std::ios_base::failure("Too many input undo records");
+        }
+        vprevout.resize(count);
+        for (auto& prevout : vprevout) {
+            ::Unserialize(s, TxInUndoDeserializer(&prevout));
+        }
+    }
+};
+
+/** Undo information for a CBlock, one CTxUndo for every tx but the coinbase */
+class CBlockUndo
+{
+public:
+    arena_vector<CTxUndo> vtxundo; // for all but the coinbase
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, vtxundo);
+    }
+};
+
+#endif // BITCOIN_UNDO_H
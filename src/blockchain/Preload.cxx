@@ -0,0 +1,1719 @@
+#include <electrumz/TXODB.h>
+#include <electrumz/Preload.h>
+#include <electrumz/BoundedQueue.h>
+#include <electrumz/MappedFile.h>
+#include <electrumz/ExternalSort.h>
+
+#include <lmdb.h>
+#include <spdlog/spdlog.h>
+#include <electrumz/bitcoin/arena.h>
+#include <electrumz/bitcoin/block.h>
+#include <electrumz/bitcoin/hash.h>
+#include <electrumz/bitcoin/merkle.h>
+#include <electrumz/bitcoin/streams.h>
+#include <electrumz/bitcoin/undo.h>
+#include <electrumz/bitcoin/crypto_common.h>
+#include <electrumz/bitcoin/util_strencodings.h>
+
+#include <filesystem>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <deque>
+#include <map>
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+using namespace electrumz;
+using namespace electrumz::blockchain;
+using namespace electrumz::util;
+
+static const char PRELOAD_NET_MAGIC[4] = { '\xfa', '\xbf', '\xb5', '\xda' };
+
+static bool IsNetMagic(const unsigned char* m) {
+	return memcmp(m, PRELOAD_NET_MAGIC, 4) == 0;
+}
+
+/**
+ * Undo data of one rev file, indexed so blocks can find their record.
+ * Core writes undo records in the order blocks were connected, which is not
+ * always the order of the blk file. Every record ends with
+ * Hash(prev block hash, undo), that confirms a match.
+*/
+class electrumz::blockchain::PreloadUndoFile {
+public:
+	bool Open(const std::filesystem::path& rev_path) {
+		if (!this->file.Open(rev_path.string())) {
+			return false;
+		}
+		this->file.Advise(MapAccess::Random);
+
+		const unsigned char* p = this->file.data();
+		uint64_t fsize = this->file.size();
+		uint64_t pos = 0;
+		while (pos + 8 <= fsize) {
+			uint32_t len = ReadLE32(p + pos + 4);
+			if (len == 0 || !IsNetMagic(p + pos)) {
+				break;
+			}
+			pos += 8;
+			if (pos + len + 32 > fsize) {
+				spdlog::error("Undo record at {}:{} is truncated", rev_path.filename().string(), pos);
+				break;
+			}
+
+			uint64_t shape;
+			if (Shape(p + pos, len, shape)) {
+				this->byShape[shape].push_back(this->records.size());
+				this->records.push_back({ p + pos, len, p + pos + len, false });
+			}
+			pos += len + 32;
+		}
+		return true;
+	}
+
+	/// Finds the undo record of a block by its prev hash and its first two tx/input counts
+	bool Find(const uint256& prevHash, uint64_t shape, const unsigned char*& data, uint32_t& size) {
+		std::lock_guard<std::mutex> lk(this->lock);
+		auto it = this->byShape.find(shape);
+		if (it == this->byShape.end()) {
+			return false;
+		}
+
+		//records are mostly in blk order, so the first unused candidate usually matches
+		for (auto r : it->second) {
+			auto& rec = this->records[r];
+			if (rec.used) {
+				continue;
+			}
+
+			unsigned char checksum[CHash256::OUTPUT_SIZE];
+			CHash256().Write(prevHash.begin(), prevHash.size()).Write(rec.data, rec.size).Finalize(checksum);
+			if (memcmp(checksum, rec.checksum, sizeof(checksum)) == 0) {
+				rec.used = true;
+				data = rec.data;
+				size = rec.size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// Number of txs with undo data and inputs of the first one, 0 if the block spends nothing
+	static uint64_t Shape(uint64_t ntxundo, uint64_t nvin) {
+		return (ntxundo << 32) | (nvin & 0xffffffff);
+	}
+private:
+	static bool Shape(const unsigned char* data, uint32_t size, uint64_t& shape) {
+		try {
+			SpanReader ds(SER_DISK, PROTOCOL_VERSION, data, size);
+			auto ntxundo = ReadCompactSize(ds);
+			if (ntxundo == 0) {
+				return false;
+			}
+			shape = Shape(ntxundo, ReadCompactSize(ds));
+			return true;
+		}
+		catch (std::ios_base::failure&) {
+			return false;
+		}
+	}
+
+	struct Record {
+		const unsigned char* data;
+		uint32_t size;
+		const unsigned char* checksum;
+		bool used;
+	};
+
+	MappedFile file;
+	std::vector<Record> records;
+	std::unordered_map<uint64_t, std::vector<size_t>> byShape;
+	std::mutex lock;
+};
+
+/// Block hashes and txids are already uniformly distributed
+class PreloadHasher {
+public:
+	size_t operator()(const uint256& h) const {
+		return (size_t)ReadLE64(h.begin());
+	}
+	size_t operator()(const COutPoint& o) const {
+		return (size_t)(ReadLE64(o.hash.begin()) ^ o.n);
+	}
+};
+
+/**
+ * Where a header was found and how much work its chain has.
+*/
+class PreloadHeader {
+public:
+	uint256 prev;
+	uint32_t nBits;
+	PreloadBlockPos pos;
+
+	//total work up to and including this block, or one of the PRELOAD_WORK_ values
+	long double work;
+};
+
+static constexpr long double PRELOAD_WORK_UNKNOWN = -1;
+static constexpr long double PRELOAD_WORK_NOT_CONNECTED = -2;
+
+/// Work of a block from its nBits (GetBlockProof), a long double is plenty to compare chains
+static long double PreloadBlockWork(uint32_t nBits) {
+	int exponent = nBits >> 24;
+	uint32_t mantissa = nBits & 0x007fffff;
+	if (mantissa == 0 || (nBits & 0x00800000) != 0) {
+		return 0;
+	}
+	long double target = std::ldexp((long double)mantissa, 8 * (exponent - 3));
+	return std::ldexp(1.0L, 256) / (target + 1);
+}
+
+/// Reads only the 80 byte header of every block in a blk file
+static void PreloadScanFile(uint32_t n, const std::filesystem::path& blk_path, std::vector<std::pair<uint256, PreloadHeader>>& out) {
+	MappedFile bf;
+	if (!bf.Open(blk_path.string())) {
+		return;
+	}
+	//only one page of every block is touched
+	bf.Advise(MapAccess::Random);
+
+	const unsigned char* p = bf.data();
+	uint64_t fsize = bf.size();
+	uint64_t pos = 0;
+
+	while (pos + 8 <= fsize) {
+		const unsigned char* net_magic = p + pos;
+		uint32_t len = ReadLE32(p + pos + 4);
+		pos += 8;
+
+		if (len == 0) {
+			break; //rest of the file is pre-allocated
+		}
+
+		if (!IsNetMagic(net_magic)) {
+			spdlog::warn("Invalid blockchain {}", len);
+			continue;
+		}
+
+		//peek and see if we have a missing block
+		if (pos + 4 <= fsize && IsNetMagic(p + pos)) {
+			//we haved an empty block go skip to next read
+			continue;
+		}
+
+		if (pos + len > fsize || len < 80) {
+			spdlog::error("Block at {}:{} is truncated", blk_path.filename().string(), pos);
+			break;
+		}
+
+		CBlockHeader header;
+		SpanReader ds(SER_DISK, PROTOCOL_VERSION, p + pos, 80);
+		ds >> header;
+
+		PreloadHeader h;
+		h.prev = header.hashPrevBlock;
+		h.nBits = header.nBits;
+		h.pos = { n, len, pos };
+		h.work = PRELOAD_WORK_UNKNOWN;
+		out.emplace_back(header.GetHash(), h);
+		pos += len;
+	}
+}
+
+/**
+ * Scans the headers of all blk files and returns the blocks of the chain
+ * with the most work in height order. Stale blocks and blocks that do not
+ * connect to the genesis block are left out.
+*/
+static bool PreloadBestChain(const std::vector<std::filesystem::path>& blks, uint32_t threads, std::vector<PreloadBlockPos>& chain) {
+	auto start = std::chrono::system_clock::now();
+
+	std::atomic<uint32_t> nextFile = 0;
+	std::vector<std::vector<std::pair<uint256, PreloadHeader>>> found(threads);
+	std::vector<std::thread> scanners;
+	for (uint32_t x = 0; x < threads; x++) {
+		scanners.emplace_back([&, x] {
+			uint32_t n;
+			while ((n = nextFile++) < blks.size()) {
+				PreloadScanFile(n, blks[n], found[x]);
+			}
+		});
+	}
+	for (auto& t : scanners) {
+		t.join();
+	}
+
+	std::unordered_map<uint256, PreloadHeader, PreloadHasher> headers;
+	for (auto& f : found) {
+		for (auto& h : f) {
+			headers.emplace(h.first, h.second);
+		}
+		std::vector<std::pair<uint256, PreloadHeader>>().swap(f);
+	}
+
+	//sum the work of every block, walking up to the first block that is known
+	const uint256* best = nullptr;
+	long double bestWork = 0;
+	std::vector<std::pair<const uint256, PreloadHeader>*> path;
+	for (auto& entry : headers) {
+		path.clear();
+		auto cur = &entry;
+		long double work = 0;
+		while (true) {
+			if (cur->second.work != PRELOAD_WORK_UNKNOWN) {
+				work = cur->second.work;
+				break;
+			}
+			path.push_back(cur);
+			if (cur->second.prev.IsNull()) {
+				break;
+			}
+			auto prev = headers.find(cur->second.prev);
+			if (prev == headers.end()) {
+				work = PRELOAD_WORK_NOT_CONNECTED;
+				break;
+			}
+			cur = &*prev;
+		}
+
+		for (auto it = path.rbegin(); it != path.rend(); it++) {
+			if (work != PRELOAD_WORK_NOT_CONNECTED) {
+				work += PreloadBlockWork((*it)->second.nBits);
+			}
+			(*it)->second.work = work;
+		}
+
+		if (entry.second.work > bestWork) {
+			bestWork = entry.second.work;
+			best = &entry.first;
+		}
+	}
+
+	if (best == nullptr) {
+		spdlog::error("No blocks found that connect to a genesis block");
+		return false;
+	}
+
+	chain.clear();
+	for (auto it = headers.find(*best); it != headers.end(); it = headers.find(it->second.prev)) {
+		chain.push_back(it->second.pos);
+		if (it->second.prev.IsNull()) {
+			break;
+		}
+	}
+	std::reverse(chain.begin(), chain.end());
+
+	std::chrono::duration<double> nt = std::chrono::system_clock::now() - start;
+	spdlog::info("Scanned {:n} headers in {:.1f}s, best chain height {:n} ({:n} blocks left out)", headers.size(), nt.count(), chain.size() - 1, headers.size() - chain.size());
+	return true;
+}
+
+/**
+ * Blk files, and their undo files, opened on demand.
+ * Blocks of neighbouring files are interleaved in height order, so a file is
+ * kept open until the last block of the chain in it is read, it is opened and
+ * its undo records indexed once. The blocks in the pipeline hold it after that.
+*/
+class PreloadFiles {
+public:
+	PreloadFiles(const std::vector<std::filesystem::path>& blks, const std::vector<PreloadBlockPos>& chain)
+		: blks(blks), files(blks.size()), undos(blks.size()), left(blks.size()) {
+		for (const auto& pos : chain) {
+			this->left[pos.file]++;
+		}
+	}
+
+	bool Get(uint32_t n, std::shared_ptr<MappedFile>& file, std::shared_ptr<PreloadUndoFile>& uf) {
+		std::lock_guard<std::mutex> lk(this->lock);
+		if (!this->files[n] && !this->Open(n)) {
+			return false;
+		}
+		file = this->files[n];
+		uf = this->undos[n];
+
+		//no more blocks of the chain in this file
+		if (--this->left[n] == 0) {
+			this->files[n].reset();
+			this->undos[n].reset();
+		}
+		return true;
+	}
+private:
+	bool Open(uint32_t n) {
+		spdlog::info("Loading block file {} ({}/{})", this->blks[n].filename().string(), n + 1, this->blks.size());
+		auto file = std::make_shared<MappedFile>();
+		if (!file->Open(this->blks[n].string())) {
+			return false;
+		}
+		//blocks are read in height order, which jumps around inside a file,
+		//sequential read ahead would load the wrong ranges and drop pages early
+		file->Advise(MapAccess::Normal);
+
+		//revNNNNN.dat holds the undo data of blkNNNNN.dat
+		auto rev_path = this->blks[n].parent_path() / ("rev" + this->blks[n].filename().string().substr(3));
+		auto uf = std::make_shared<PreloadUndoFile>();
+		if (!uf->Open(rev_path)) {
+			spdlog::error("No undo data for {}", this->blks[n].filename().string());
+			return false;
+		}
+
+		this->files[n] = std::move(file);
+		this->undos[n] = std::move(uf);
+		return true;
+	}
+
+	const std::vector<std::filesystem::path>& blks;
+	std::mutex lock;
+	std::vector<std::shared_ptr<MappedFile>> files;
+	std::vector<std::shared_ptr<PreloadUndoFile>> undos;
+
+	//blocks of the chain not read yet, by file
+	std::vector<uint32_t> left;
+};
+
+/// Checks a raw block in the mapped file, nothing is decoded into a CBlock
+static bool PreloadParseBlock(RawBlock& raw, ParsedBlock& parsed) {
+	if (!parsed.block.Parse(raw.data, raw.size)) {
+		spdlog::error("Failed to parse block at height {}", raw.height);
+		return false;
+	}
+	parsed.file = std::move(raw.file);
+	parsed.undo = std::move(raw.undo);
+	parsed.height = raw.height;
+	parsed.size = raw.size;
+	return true;
+}
+
+/// Collects scriptPubKeys so their scriptHashes are computed in one SHashBatch call, reused for every block of a thread
+struct PreloadScripts {
+	std::vector<const unsigned char*> data;
+	std::vector<size_t> len;
+	std::vector<uint256> hashes;
+
+	void Clear() {
+		this->data.clear();
+		this->len.clear();
+	}
+
+	void Add(const unsigned char* script, size_t size) {
+		this->data.push_back(script);
+		this->len.push_back(size);
+	}
+
+	void Hash() {
+		this->hashes.resize(this->data.size());
+		SHashBatch(this->hashes.data(), this->data.data(), this->len.data(), this->data.size());
+	}
+};
+
+/// Rebuilds the outputs spent by a block from its undo record, idx.spends must be filled already
+static bool PreloadUndoBlock(const CBlockView& blk, PreloadUndoFile& undo, PreloadScripts& scripts, Arena& arena, IndexedBlock& idx) {
+	auto txs = blk.Transactions();
+	auto second = ++txs.begin();
+
+	const unsigned char* data;
+	uint32_t size;
+	if (!undo.Find(blk.header.hashPrevBlock, PreloadUndoFile::Shape(txs.size() - 1, second->InputCount()), data, size)) {
+		spdlog::error("No undo record for block {}", idx.hash.GetHex());
+		return false;
+	}
+
+	//the undo record of the last block is gone, reuse its memory
+	arena.Reset();
+	Arena::Scope scope(arena);
+
+	CBlockUndo blockUndo;
+	try {
+		SpanReader ds(SER_DISK, PROTOCOL_VERSION, data, size);
+		ds >> blockUndo;
+	}
+	catch (std::ios_base::failure& ex) {
+		spdlog::error("Failed to parse undo record of block {}: {}", idx.hash.GetHex(), ex.what());
+		return false;
+	}
+
+	if (blockUndo.vtxundo.size() != txs.size() - 1) {
+		spdlog::error("Undo record does not match block {}", idx.hash.GetHex());
+		return false;
+	}
+
+	scripts.Clear();
+	size_t x = 0;
+	for (auto it = second; it != txs.end(); ++it) {
+		const auto& txUndo = blockUndo.vtxundo[x++];
+		if (txUndo.vprevout.size() != it->InputCount()) {
+			spdlog::error("Undo record does not match block {}", idx.hash.GetHex());
+			return false;
+		}
+		for (const auto& coin : txUndo.vprevout) {
+			scripts.Add(coin.out.scriptPubKey.data(), coin.out.scriptPubKey.size());
+		}
+	}
+	if (scripts.data.size() != idx.spends.size()) {
+		spdlog::error("Undo record does not match block {}", idx.hash.GetHex());
+		return false;
+	}
+	scripts.Hash();
+
+	//one entry per input of every tx but the coinbase, in the same order as spends
+	std::vector<TXO> spent;
+	spent.reserve(idx.spends.size());
+	size_t input = 0;
+	for (const auto& txUndo : blockUndo.vtxundo) {
+		for (const auto& coin : txUndo.vprevout) {
+			const auto& spend = idx.spends[input];
+			spent.emplace_back(scripts.hashes[input], spend.first.hash, spend.first.n, coin.out.nValue, coin.nHeight);
+			spent.back().spend = spend.second;
+			input++;
+		}
+	}
+	idx.spentOutputs = std::move(spent);
+	return true;
+}
+
+/// Computes the block hash and the scriptHash of every output, false if checkMerkle finds a bad merkle root or the undo record is unusable
+static bool PreloadHashBlock(const ParsedBlock& parsed, PreloadScripts& scripts, Arena& arena, IndexedBlock& idx, bool checkMerkle) {
+	auto& blk = parsed.block;
+	idx.hash = blk.GetHash();
+	idx.header = blk.header;
+	idx.ntx = blk.TransactionCount();
+	idx.height = parsed.height;
+	idx.size = parsed.size;
+
+	//hash every scriptPubKey of the block in one batch
+	scripts.Clear();
+	size_t nInputs = 0;
+	for (const auto& tx : blk.Transactions()) {
+		for (const auto& ntxo : tx.Outputs()) {
+			scripts.Add(ntxo.scriptPubKey, ntxo.scriptPubKeySize);
+		}
+		nInputs += tx.InputCount();
+	}
+	scripts.Hash();
+	idx.outputs.reserve(scripts.data.size());
+	idx.spends.reserve(nInputs);
+	idx.spendTxs.reserve(nInputs);
+	idx.txids.reserve(idx.ntx);
+
+	size_t script = 0;
+	for (const auto& tx : blk.Transactions()) {
+		uint256 txHash = tx.GetHash();
+		uint64_t txPos = idx.txids.size();
+		idx.txids.push_back(txHash);
+
+		uint32_t txop = 0;
+		for (const auto& ntxo : tx.Outputs()) {
+			idx.outputs.emplace_back(scripts.hashes[script++], txHash, txop++, ntxo.nValue, 0);
+			idx.outputs.back().txNum = txPos;
+		}
+
+		uint32_t txip = 0;
+		for (const auto& ntxi : tx.Inputs()) {
+			//check is coinbase txin
+			COutPoint prevout = ntxi.GetPrevout();
+			if (!prevout.IsNull()) {
+				idx.spends.emplace_back(prevout, COutPoint(txHash, txip));
+				idx.spendTxs.push_back((uint32_t)txPos);
+			}
+			txip++;
+		}
+	}
+
+	if (checkMerkle) {
+		bool mutated = false;
+		if (ComputeMerkleRoot(idx.txids, &mutated) != blk.header.hashMerkleRoot || mutated) {
+			spdlog::error("Bad merkle root in block {} at height {}", idx.hash.GetHex(), idx.height);
+			return false;
+		}
+	}
+
+	if (parsed.undo && idx.ntx > 1 && !PreloadUndoBlock(blk, *parsed.undo, scripts, arena, idx)) {
+		return false;
+	}
+	return true;
+}
+
+/// Approximate bytes a single output adds to a write batch (addr + txo record)
+static constexpr uint64_t PRELOAD_OUTPUT_BYTES = 32 + FixedCodec<TXORef>::Size + 32 + FixedCodec<TXO>::Size;
+
+/**
+ * Block bytes written between two forced syncs, the size of a blk file.
+ * The env runs with MDB_NOSYNC, a sync bounds how much is lost on a crash.
+*/
+static constexpr uint64_t PRELOAD_SYNC_BYTES = 1024 * 1024 * 128;
+
+/// Bytes of a txnum record
+static constexpr uint64_t PRELOAD_TXNUM_BYTES = TXNUM_SIZE + TXNUM_RECORD_SIZE;
+
+/// DBI_TXNUM value of the x'th tx of a batch, block is the batch block of the last call and only moves forward
+static void PreloadTxNumRecord(const PreloadBatch& batch, size_t x, size_t& block, unsigned char* p) {
+	while (block + 1 < batch.heights.size() && batch.heights[block + 1].second <= batch.firstTxNum + x) {
+		block++;
+	}
+	memcpy(p, batch.txids[x].begin(), 32);
+	WriteLE32(p + 32, batch.heights[block].first);
+}
+
+/**
+ * DBI_TXO record of an input spending from a scriptHash, stored under the spending tx.
+ * Only written with prefix keys, its scriptHash tail tells the inputs of colliding
+ * addresses apart. value is not kept, height is the height of the spending block.
+*/
+static TXO PreloadInputTXO(const PreloadHistoryTx& h) {
+	return TXO(h.scriptHash, h.txid, h.n, 0, h.height);
+}
+
+/// Bytes of a history tx waiting to be hashed into a status
+static constexpr uint64_t PRELOAD_HISTORY_BYTES = sizeof(PreloadHistoryTx);
+
+/// Bytes of a spend record, prevout -> spending input
+static constexpr uint64_t PRELOAD_SPEND_BYTES = FixedCodec<COutPoint>::Size * 2;
+
+/**
+ * Unspent outputs that are not written yet.
+ * Most outputs are spent soon after they are created, those are written once
+ * with their spend set. The oldest outputs leave first once the cache is full.
+*/
+class PreloadOutputCache {
+public:
+	PreloadOutputCache(size_t capacity) : capacity(capacity) { }
+
+	void Add(const TXO& t) {
+		COutPoint op(t.txHash, t.n);
+		this->outputs[op] = t;
+		this->order.push_back(op);
+	}
+
+	/// Moves a cached output to out with its spend set, false if it is not cached
+	bool Spend(const COutPoint& prevout, const COutPoint& spend, std::vector<TXO>& out) {
+		auto it = this->outputs.find(prevout);
+		if (it == this->outputs.end()) {
+			return false;
+		}
+		it->second.spend = spend;
+		out.push_back(std::move(it->second));
+		this->outputs.erase(it);
+		return true;
+	}
+
+	/// Moves the oldest outputs to out until the cache is back under capacity
+	void Evict(std::vector<TXO>& out) {
+		while (this->outputs.size() > this->capacity && !this->order.empty()) {
+			this->PopOldest(out);
+		}
+
+		//spent outputs leave stale entries in order, drop them once they pile up
+		if (this->order.size() > 2 * this->outputs.size() + 1024) {
+			std::deque<COutPoint> live;
+			for (const auto& op : this->order) {
+				if (this->outputs.find(op) != this->outputs.end()) {
+					live.push_back(op);
+				}
+			}
+			this->order.swap(live);
+		}
+	}
+
+	/// Moves every cached output to out
+	void Drain(std::vector<TXO>& out) {
+		while (!this->order.empty()) {
+			this->PopOldest(out);
+		}
+	}
+
+	size_t Size() const { return this->outputs.size(); }
+private:
+	void PopOldest(std::vector<TXO>& out) {
+		auto it = this->outputs.find(this->order.front());
+		this->order.pop_front();
+		if (it != this->outputs.end()) {
+			out.push_back(std::move(it->second));
+			this->outputs.erase(it);
+		}
+	}
+
+	size_t capacity;
+	std::unordered_map<COutPoint, TXO, PreloadHasher> outputs;
+	std::deque<COutPoint> order;
+};
+
+int TXODB::PreloadWriteBatch(const PreloadBatch& batch) {
+	int err = 0;
+	MDB_txn* txn;
+	MDB_cursor* curtx;
+	MDB_cursor* cursp;
+	MDB_cursor* curnum;
+	MDB_cursor* curid;
+	MDB_stat st_addrid;
+
+	//sort outputs by their address key so the addr B-tree is walked in order
+	//instead of touching random pages for every output
+	std::vector<const TXO*> by_addr;
+	for (const auto& t : batch.outputs) {
+		by_addr.push_back(&t);
+	}
+	std::vector<const TXO*> by_tx = by_addr;
+
+	//inputs go in next to the outputs of their tx
+	std::vector<TXO> inputs;
+	if (this->addrKeyBytes < ADDR_KEY_MAX) {
+		for (const auto& h : batch.history) {
+			if (TXORef(h.txNum, h.n).IsInput()) {
+				inputs.push_back(PreloadInputTXO(h));
+			}
+		}
+	}
+	for (const auto& t : inputs) {
+		by_tx.push_back(&t);
+	}
+
+	std::sort(by_addr.begin(), by_addr.end(), [](const TXO* a, const TXO* b) {
+		int cmp = a->scriptHash.Compare(b->scriptHash);
+		return cmp < 0 || (cmp == 0 && TXORef(a->txNum, a->n) < TXORef(b->txNum, b->n));
+		});
+	std::sort(by_tx.begin(), by_tx.end(), [](const TXO* a, const TXO* b) {
+		return COutPoint(a->txHash, a->n) < COutPoint(b->txHash, b->n);
+		});
+
+	//the outputs and the inputs spending from each address go in its posting list
+	std::vector<std::pair<const uint256*, TXORef>> postings;
+	postings.reserve(batch.outputs.size());
+	for (auto t : by_addr) {
+		postings.emplace_back(&t->scriptHash, TXORef(t->txNum, t->n));
+	}
+	for (const auto& h : batch.history) {
+		if (TXORef(h.txNum, h.n).IsInput()) {
+			postings.emplace_back(&h.scriptHash, TXORef(h.txNum, h.n));
+		}
+	}
+	std::sort(postings.begin(), postings.end(), [](const std::pair<const uint256*, TXORef>& a, const std::pair<const uint256*, TXORef>& b) {
+		int cmp = a.first->Compare(*b.first);
+		return cmp < 0 || (cmp == 0 && a.second < b.second);
+		});
+
+	//every spend of the batch, cached or not, goes to the spend dbi in key order
+	std::vector<std::pair<COutPoint, COutPoint>> spends;
+	for (const auto& t : batch.outputs) {
+		if (!t.spend.IsNull()) {
+			spends.emplace_back(COutPoint(t.txHash, t.n), t.spend);
+		}
+	}
+	for (const auto& t : batch.spentOutputs) {
+		spends.emplace_back(COutPoint(t.txHash, t.n), t.spend);
+	}
+	std::sort(spends.begin(), spends.end());
+
+	//balance changes of the batch
+	std::map<uint256, AddrBalance> balances;
+	for (const auto& t : batch.outputs) {
+		auto& b = balances[t.scriptHash];
+		b.Receive(t.value);
+		if (!t.spend.IsNull()) {
+			b.Spend(t.value);
+		}
+	}
+	for (const auto& t : batch.spentOutputs) {
+		balances[t.scriptHash].Spend(t.value);
+	}
+
+	std::vector<TXORef> refs;
+
+try_batch_again:
+	if (err = mdb_txn_begin(this->env, nullptr, 0, &txn)) {
+		spdlog::error("Failed to start txo: {}", mdb_strerror(err));
+		return err;
+	}
+
+	//records are encoded in place, straight into the map for blk and on the
+	//stack for the dupsort dbis (MDB_RESERVE is not allowed with MDB_DUPSORT)
+	unsigned char txo_buf[TXORecord::MaxSize];
+	auto txoSize = TXORecord::Size(this->addrKeyBytes);
+	unsigned char num_buf[TXNUM_SIZE];
+	unsigned char height_buf[4];
+
+	//Store the block headers
+	for (const auto& blk : batch.headers) {
+		MDB_val blk_key = {
+			blk.first.size(),
+			(void*)blk.first.begin()
+		};
+		MDB_val blk_val = {
+			FixedCodec<CBlockHeader>::Size,
+			nullptr
+		};
+
+		err = mdb_put(txn, this->dbi_blk, &blk_key, &blk_val, MDB_NODUPDATA | MDB_RESERVE);
+		if (err != 0) {
+			spdlog::error("AddBLK write failed {}", mdb_strerror(err));
+			goto batch_failed;
+		}
+		FixedCodec<CBlockHeader>::Write((unsigned char*)blk_val.mv_data, blk.second);
+	}
+
+	if (!batch.txids.empty()) {
+		if (err = mdb_cursor_open(txn, this->dbi_txnum, &curnum)) {
+			spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+			goto batch_failed;
+		}
+
+		//numbers only grow, so the records go on the end of the tree unless
+		//the chain is loaded again over an existing db
+		MDB_val last_key, last_val;
+		err = mdb_cursor_get(curnum, &last_key, &last_val, MDB_LAST);
+		bool append = err == MDB_NOTFOUND || (err == 0 && last_key.mv_size == TXNUM_SIZE && ReadTxNum((const unsigned char*)last_key.mv_data) < batch.firstTxNum);
+		size_t block = 0;
+		unsigned char rec_buf[TXNUM_RECORD_SIZE];
+		for (size_t x = 0; x < batch.txids.size(); x++) {
+			WriteTxNum(num_buf, batch.firstTxNum + x);
+			PreloadTxNumRecord(batch, x, block, rec_buf);
+			MDB_val num_key = {
+				sizeof(num_buf),
+				num_buf
+			};
+			MDB_val num_val = {
+				sizeof(rec_buf),
+				rec_buf
+			};
+
+			err = mdb_cursor_put(curnum, &num_key, &num_val, append ? MDB_APPEND : 0);
+			if (err != 0) {
+				spdlog::error("AddTXNUM write failed {}", mdb_strerror(err));
+				mdb_cursor_close(curnum);
+				goto batch_failed;
+			}
+		}
+		mdb_cursor_close(curnum);
+	}
+
+	//a few blocks per batch, no cursor needed
+	for (const auto& height : batch.heights) {
+		WriteBE32(height_buf, height.first);
+		WriteTxNum(num_buf, height.second);
+		MDB_val height_key = {
+			sizeof(height_buf),
+			height_buf
+		};
+		MDB_val height_val = {
+			sizeof(num_buf),
+			num_buf
+		};
+
+		err = mdb_put(txn, this->dbi_height, &height_key, &height_val, 0);
+		if (err != 0) {
+			spdlog::error("AddHeight write failed {}", mdb_strerror(err));
+			goto batch_failed;
+		}
+	}
+
+	//ids are dense, so the next one is the number of ids stored.
+	//by_addr has every scriptHash once in a row, in key order
+	if (err = mdb_stat(txn, this->dbi_addrid, &st_addrid)) {
+		spdlog::error("Failed to stat {}: {}", DBI_ADDRID, mdb_strerror(err));
+		goto batch_failed;
+	}
+	if (err = mdb_cursor_open(txn, this->dbi_addrid, &curid)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		goto batch_failed;
+	}
+	for (size_t x = 0; x < by_addr.size(); x++) {
+		const auto& scriptHash = by_addr[x]->scriptHash;
+		if (x > 0 && by_addr[x - 1]->scriptHash == scriptHash) {
+			continue;
+		}
+
+		MDB_val id_key = {
+			scriptHash.size(),
+			(void*)scriptHash.begin()
+		};
+		MDB_val id_val;
+		err = mdb_cursor_get(curid, &id_key, &id_val, MDB_SET);
+		if (err == MDB_NOTFOUND) {
+			if (st_addrid.ms_entries > UINT32_MAX) {
+				spdlog::error("Out of address ids");
+				err = MDB_CORRUPTED;
+			}
+			else {
+				unsigned char id_buf[4];
+				WriteLE32(id_buf, (uint32_t)st_addrid.ms_entries++);
+				id_val = { sizeof(id_buf), id_buf };
+				err = mdb_cursor_put(curid, &id_key, &id_val, 0);
+			}
+		}
+		if (err != 0) {
+			spdlog::error("AddAddrId write failed {}", mdb_strerror(err));
+			mdb_cursor_close(curid);
+			goto batch_failed;
+		}
+	}
+	mdb_cursor_close(curid);
+
+	//one merge into the posting list per address key, refs of hashes
+	//sharing a key prefix are next to each other in postings
+	for (size_t x = 0; x < postings.size();) {
+		const auto& scriptHash = *postings[x].first;
+		refs.clear();
+		for (; x < postings.size() && memcmp(postings[x].first->begin(), scriptHash.begin(), this->addrKeyBytes) == 0; x++) {
+			refs.push_back(postings[x].second);
+		}
+		std::sort(refs.begin(), refs.end());
+
+		if ((err = this->AddAddrRefs(txn, scriptHash, refs.data(), refs.size())) != TXO_OK) {
+			goto batch_failed;
+		}
+	}
+	err = 0;
+
+	if (err = mdb_cursor_open(txn, this->dbi_txo, &curtx)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		goto batch_failed;
+	}
+
+	//outputs of one tx can leave the cache in any order, so this can't append
+	for (auto t : by_tx) {
+		TXORecord::Write(txo_buf, *t, this->addrKeyBytes);
+
+		MDB_val tx_key = {
+			t->txHash.size(),
+			(void*)t->txHash.begin()
+		};
+		MDB_val tx_val = {
+			txoSize,
+			txo_buf
+		};
+
+		err = mdb_cursor_put(curtx, &tx_key, &tx_val, MDB_NODUPDATA);
+		if (err == MDB_KEYEXIST) {
+			spdlog::warn("Duplicate output {}:{}", t->txHash.GetHex(), t->n);
+		}
+		else if (err != 0) {
+			spdlog::error("AddTXO write failed {}", mdb_strerror(err));
+			mdb_cursor_close(curtx);
+			goto batch_failed;
+		}
+	}
+
+	mdb_cursor_close(curtx);
+
+	//the txo records stay as they are, a spend is a record of its own
+	if (err = mdb_cursor_open(txn, this->dbi_spend, &cursp)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		goto batch_failed;
+	}
+	for (const auto& spend : spends) {
+		if ((err = this->InternalSpendTXO(cursp, spend.first, spend.second)) != TXO_OK) {
+			mdb_cursor_close(cursp);
+			goto batch_failed;
+		}
+	}
+	mdb_cursor_close(cursp);
+	err = 0;
+
+	if ((err = this->AddBalances(txn, balances)) != TXO_OK) {
+		goto batch_failed;
+	}
+	if ((err = this->AppendStatus(txn, batch.history)) != TXO_OK) {
+		goto batch_failed;
+	}
+	err = 0;
+
+	if (err = mdb_txn_commit(txn)) {
+		spdlog::error("Failed to commit batch: {}", mdb_strerror(err));
+		return err;
+	}
+	return TXO_OK;
+
+batch_failed:
+	mdb_txn_abort(txn);
+	if (err == MDB_MAP_FULL) {
+		//the batch is still in memory, grow the map and write it again
+		if ((err = this->IncreaseMapSize()) != TXO_RESIZED) {
+			spdlog::error("Failed to increase map size, writer exiting..");
+			return err;
+		}
+		goto try_batch_again;
+	}
+	return err;
+}
+
+/**
+ * Sorted runs for each dbi, used by the bulk preload
+*/
+class PreloadSorters {
+public:
+	PreloadSorters(const std::string& dir, uint64_t memBytes)
+		: addr(dir, DBI_ADDR, memBytes / 4),
+		txo(dir, DBI_TXO, memBytes / 4, TXOCompare),
+		blk(dir, DBI_BLK, SMALL_SORT_BYTES),
+		txnum(dir, DBI_TXNUM, SMALL_SORT_BYTES),
+		height(dir, DBI_HEIGHT, SMALL_SORT_BYTES),
+		addrid(dir, DBI_ADDRID, memBytes / 8),
+		spend(dir, DBI_SPEND, memBytes / 8),
+		balance(dir, DBI_BALANCE, memBytes / 16),
+		status(dir, DBI_STATUS, memBytes / 16 * 3) { }
+
+	ExternalSorter addr;
+	ExternalSorter txo;
+	ExternalSorter blk;
+
+	//already in key order, sorting them is only a copy
+	ExternalSorter txnum;
+	ExternalSorter height;
+
+	//scriptHash of every output, numbered once they are sorted
+	ExternalSorter addrid;
+
+	//every spend, keyed by its prevout
+	ExternalSorter spend;
+
+	//one balance change per output and per spent output, summed when merged
+	ExternalSorter balance;
+
+	//history txs by scriptHash and tx number, hashed when merged
+	ExternalSorter status;
+private:
+	//headers and block heights are small next to the outputs
+	static constexpr uint64_t SMALL_SORT_BYTES = 1024 * 1024 * 64;
+};
+
+/// Bulk preload, queues the records of a batch in the sorters instead of writing them
+static int PreloadSpillBatch(const PreloadBatch& batch, PreloadSorters& sorters, uint32_t addrKeyBytes) {
+	int err = 0;
+	unsigned char buf[FixedCodec<CBlockHeader>::Size];
+	static_assert(sizeof(buf) >= TXORecord::MaxSize, "spill buffer too small");
+	static_assert(sizeof(buf) >= FixedCodec<AddrBalance>::Size, "spill buffer too small");
+	static_assert(sizeof(buf) >= 32 + TXNUM_SIZE + 32 + 4, "spill buffer too small");
+	auto txoSize = TXORecord::Size(addrKeyBytes);
+
+	for (const auto& blk : batch.headers) {
+		FixedCodec<CBlockHeader>::Write(buf, blk.second);
+		if (err = sorters.blk.Add(blk.first.begin(), blk.first.size(), buf, FixedCodec<CBlockHeader>::Size)) {
+			return err;
+		}
+	}
+
+	for (const auto& height : batch.heights) {
+		WriteBE32(buf, height.first);
+		WriteTxNum(buf + 4, height.second);
+		if (err = sorters.height.Add(buf, 4, buf + 4, TXNUM_SIZE)) {
+			return err;
+		}
+	}
+
+	size_t block = 0;
+	for (size_t x = 0; x < batch.txids.size(); x++) {
+		WriteTxNum(buf, batch.firstTxNum + x);
+		PreloadTxNumRecord(batch, x, block, buf + TXNUM_SIZE);
+		if (err = sorters.txnum.Add(buf, TXNUM_SIZE, buf + TXNUM_SIZE, TXNUM_RECORD_SIZE)) {
+			return err;
+		}
+	}
+
+	//inputs spending from an address, its outputs are added below
+	for (const auto& h : batch.history) {
+		TXORef ref(h.txNum, h.n);
+		if (ref.IsInput()) {
+			FixedCodec<TXORef>::Write(buf, ref);
+			if (err = sorters.addr.Add(h.scriptHash.begin(), addrKeyBytes, buf, FixedCodec<TXORef>::Size)) {
+				return err;
+			}
+			if (addrKeyBytes < ADDR_KEY_MAX) {
+				TXORecord::Write(buf, PreloadInputTXO(h), addrKeyBytes);
+				if (err = sorters.txo.Add(h.txid.begin(), h.txid.size(), buf, txoSize)) {
+					return err;
+				}
+			}
+		}
+	}
+
+	for (const auto& t : batch.outputs) {
+		FixedCodec<TXORef>::Write(buf, TXORef(t.txNum, t.n));
+		if (err = sorters.addr.Add(t.scriptHash.begin(), addrKeyBytes, buf, FixedCodec<TXORef>::Size)) {
+			return err;
+		}
+		if (err = sorters.addrid.Add(t.scriptHash.begin(), t.scriptHash.size(), buf, 0)) {
+			return err;
+		}
+
+		TXORecord::Write(buf, t, addrKeyBytes);
+		if (err = sorters.txo.Add(t.txHash.begin(), t.txHash.size(), buf, txoSize)) {
+			return err;
+		}
+	}
+
+	//spends from the cache and from the undo data look the same
+	auto addSpend = [&](const COutPoint& prevout, const COutPoint& spendingTx) {
+		FixedCodec<COutPoint>::Write(buf, prevout);
+		FixedCodec<COutPoint>::Write(buf + FixedCodec<COutPoint>::Size, spendingTx);
+		return sorters.spend.Add(buf, FixedCodec<COutPoint>::Size, buf + FixedCodec<COutPoint>::Size, FixedCodec<COutPoint>::Size);
+	};
+	for (const auto& t : batch.outputs) {
+		if (!t.spend.IsNull() && (err = addSpend(COutPoint(t.txHash, t.n), t.spend))) {
+			return err;
+		}
+	}
+	for (const auto& t : batch.spentOutputs) {
+		if (err = addSpend(COutPoint(t.txHash, t.n), t.spend)) {
+			return err;
+		}
+	}
+
+	for (const auto& t : batch.outputs) {
+		AddrBalance b;
+		b.Receive(t.value);
+		if (!t.spend.IsNull()) {
+			b.Spend(t.value);
+		}
+		FixedCodec<AddrBalance>::Write(buf, b);
+		if (err = sorters.balance.Add(t.scriptHash.begin(), t.scriptHash.size(), buf, FixedCodec<AddrBalance>::Size)) {
+			return err;
+		}
+	}
+	for (const auto& t : batch.spentOutputs) {
+		AddrBalance b;
+		b.Spend(t.value);
+		FixedCodec<AddrBalance>::Write(buf, b);
+		if (err = sorters.balance.Add(t.scriptHash.begin(), t.scriptHash.size(), buf, FixedCodec<AddrBalance>::Size)) {
+			return err;
+		}
+	}
+
+	for (const auto& h : batch.history) {
+		memcpy(buf, h.scriptHash.begin(), h.scriptHash.size());
+		WriteTxNum(buf + 32, h.txNum);
+		memcpy(buf + 32 + TXNUM_SIZE, h.txid.begin(), h.txid.size());
+		WriteLE32(buf + 64 + TXNUM_SIZE, h.height);
+		if (err = sorters.status.Add(buf, 32 + TXNUM_SIZE, buf + 32 + TXNUM_SIZE, 32 + 4)) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+int TXODB::BulkAppendChunk(MDB_dbi dbi, const std::vector<unsigned char>& chunk, std::vector<unsigned char>& lastKey, uint64_t& skipped) {
+	int err = 0;
+	MDB_txn* txn;
+	MDB_cursor* cur;
+
+try_chunk_again:
+	if (err = mdb_txn_begin(this->env, nullptr, 0, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
+	if (err = mdb_cursor_open(txn, dbi, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+
+	//records arrive in key order, new keys go on the end of the tree and
+	//duplicates on the end of their key
+	auto prevKey = lastKey;
+	uint64_t dups = 0;
+	size_t pos = 0;
+	while (pos < chunk.size()) {
+		MDB_val k, v;
+		pos += ExternalSorter::ReadRecord(chunk.data() + pos, k, v);
+
+		bool sameKey = prevKey.size() == k.mv_size && memcmp(prevKey.data(), k.mv_data, k.mv_size) == 0;
+		err = mdb_cursor_put(cur, &k, &v, sameKey ? MDB_APPENDDUP : MDB_APPEND);
+		if (err == MDB_KEYEXIST) {
+			//same record from a block that was stored twice
+			dups++;
+			continue;
+		}
+		if (err == 0 && !sameKey) {
+			prevKey.assign((unsigned char*)k.mv_data, (unsigned char*)k.mv_data + k.mv_size);
+		}
+
+		if (err != 0) {
+			mdb_cursor_close(cur);
+			mdb_txn_abort(txn);
+			if (err == MDB_MAP_FULL) {
+				//nothing of this chunk was written, grow the map and write it again
+				if ((err = this->IncreaseMapSize()) != TXO_RESIZED) {
+					spdlog::error("Failed to increase map size, bulk load exiting..");
+					return err;
+				}
+				goto try_chunk_again;
+			}
+			spdlog::error("Bulk append failed {}", mdb_strerror(err));
+			return err;
+		}
+	}
+	mdb_cursor_close(cur);
+
+	if (err = mdb_txn_commit(txn)) {
+		spdlog::error("Failed to commit chunk: {}", mdb_strerror(err));
+		return err;
+	}
+
+	lastKey = std::move(prevKey);
+	skipped += dups;
+	return TXO_OK;
+}
+
+int TXODB::BulkAppend(ExternalSorter& sorter, MDB_dbi dbi, uint64_t chunkBytes, BulkRecords records) {
+	int err = 0;
+	std::vector<unsigned char> chunk;
+	std::vector<unsigned char> lastKey;
+	uint64_t written = 0, skipped = 0;
+	auto total = sorter.Count();
+	auto last_print = std::chrono::system_clock::now();
+
+	//merged records are copied into a chunk so a txn can be replayed after a resize
+	chunk.reserve(chunkBytes + 1024);
+	auto flush = [&] {
+		if (chunk.empty()) {
+			return (int)TXO_OK;
+		}
+		int ret = this->BulkAppendChunk(dbi, chunk, lastKey, skipped);
+		chunk.clear();
+
+		std::chrono::duration<double> nt = std::chrono::system_clock::now() - last_print;
+		if (nt.count() >= 5) {
+			spdlog::info("Writing {}: {:n}/{:n} ({:.2f}%)", sorter.Name(), written, total, 100.0 * ((double)written / (double)total));
+			last_print = std::chrono::system_clock::now();
+		}
+		return ret;
+	};
+
+	//address ids go to each scriptHash once, numbered in key order
+	std::vector<unsigned char> lastScript;
+	uint64_t nextId = 0;
+	unsigned char id_buf[4];
+
+	//refs of the address key in lastScript, written once a chunk is full
+	std::vector<TXORef> refs;
+	std::vector<unsigned char> enc;
+	unsigned char chunk_key[ADDR_CHUNK_KEY_MAX];
+	auto addChunk = [&] {
+		if (refs.empty()) {
+			return;
+		}
+		memcpy(chunk_key, lastScript.data(), lastScript.size());
+		FixedCodec<TXORef>::Write(chunk_key + lastScript.size(), refs.front());
+		TXORefChunk::Encode(refs.data(), refs.size(), enc);
+
+		MDB_val k = {
+			lastScript.size() + FixedCodec<TXORef>::Size,
+			chunk_key
+		};
+		MDB_val v = {
+			enc.size(),
+			enc.data()
+		};
+		ExternalSorter::AppendRecord(chunk, k, v);
+		refs.clear();
+	};
+
+	//changes to the scriptHash in lastScript, written once the next one starts
+	AddrBalance balance;
+	bool haveBalance = false;
+	unsigned char bal_buf[FixedCodec<AddrBalance>::Size];
+	auto addBalance = [&] {
+		if (!haveBalance) {
+			return;
+		}
+		FixedCodec<AddrBalance>::Write(bal_buf, balance);
+		MDB_val k = {
+			lastScript.size(),
+			lastScript.data()
+		};
+		MDB_val v = {
+			sizeof(bal_buf),
+			bal_buf
+		};
+		ExternalSorter::AppendRecord(chunk, k, v);
+		haveBalance = false;
+	};
+
+	//status of the scriptHash in lastScript, its txs arrive in chain order
+	AddrStatus status;
+	uint64_t lastTxNum = 0;
+	unsigned char status_buf[AddrStatus::MaxSize];
+	auto addStatus = [&] {
+		if (status.Empty()) {
+			return;
+		}
+		MDB_val k = {
+			lastScript.size(),
+			lastScript.data()
+		};
+		MDB_val v = {
+			status.Write(status_buf),
+			status_buf
+		};
+		ExternalSorter::AppendRecord(chunk, k, v);
+		status = AddrStatus();
+	};
+
+	err = sorter.Merge([&](MDB_val& k, MDB_val& v) {
+		if (records == BulkRecords::AddrIds) {
+			if (lastScript.size() == k.mv_size && memcmp(lastScript.data(), k.mv_data, k.mv_size) == 0) {
+				return 0;
+			}
+			if (nextId > UINT32_MAX) {
+				spdlog::error("Out of address ids");
+				return (int)MDB_CORRUPTED;
+			}
+			lastScript.assign((unsigned char*)k.mv_data, (unsigned char*)k.mv_data + k.mv_size);
+			WriteLE32(id_buf, (uint32_t)nextId++);
+			MDB_val id_val = {
+				sizeof(id_buf),
+				id_buf
+			};
+			ExternalSorter::AppendRecord(chunk, k, id_val);
+		}
+		else if (records == BulkRecords::Postings) {
+			if (v.mv_size != FixedCodec<TXORef>::Size) {
+				spdlog::error("Bad {} record", sorter.Name());
+				return (int)MDB_CORRUPTED;
+			}
+			TXORef ref;
+			FixedCodec<TXORef>::Read((const unsigned char*)v.mv_data, ref);
+
+			bool sameKey = lastScript.size() == k.mv_size && memcmp(lastScript.data(), k.mv_data, k.mv_size) == 0;
+			if (sameKey && !refs.empty() && !(refs.back() < ref)) {
+				//same output from a block that was stored twice
+				written++;
+				skipped++;
+				return 0;
+			}
+			if (!sameKey || refs.size() == ADDR_CHUNK_MAX) {
+				addChunk();
+				lastScript.assign((unsigned char*)k.mv_data, (unsigned char*)k.mv_data + k.mv_size);
+			}
+			refs.push_back(ref);
+		}
+		else if (records == BulkRecords::Balances) {
+			if (v.mv_size != FixedCodec<AddrBalance>::Size) {
+				spdlog::error("Bad {} record", sorter.Name());
+				return (int)MDB_CORRUPTED;
+			}
+			AddrBalance change;
+			FixedCodec<AddrBalance>::Read((const unsigned char*)v.mv_data, change);
+
+			if (!haveBalance || lastScript.size() != k.mv_size || memcmp(lastScript.data(), k.mv_data, k.mv_size) != 0) {
+				addBalance();
+				lastScript.assign((unsigned char*)k.mv_data, (unsigned char*)k.mv_data + k.mv_size);
+				balance = AddrBalance();
+				haveBalance = true;
+			}
+			balance += change;
+		}
+		else if (records == BulkRecords::Status) {
+			if (k.mv_size != 32 + TXNUM_SIZE || v.mv_size != 32 + 4) {
+				spdlog::error("Bad {} record", sorter.Name());
+				return (int)MDB_CORRUPTED;
+			}
+			auto txNum = ReadTxNum((const unsigned char*)k.mv_data + 32);
+
+			if (status.Empty() || memcmp(lastScript.data(), k.mv_data, 32) != 0) {
+				addStatus();
+				lastScript.assign((unsigned char*)k.mv_data, (unsigned char*)k.mv_data + 32);
+			}
+			else if (txNum == lastTxNum) {
+				//a tx paying or spending more than one output is in the history once
+				written++;
+				return 0;
+			}
+			uint256 txid;
+			memcpy(txid.begin(), v.mv_data, txid.size());
+			status.Append(txid.GetHex(), (int32_t)ReadLE32((const unsigned char*)v.mv_data + 32));
+			lastTxNum = txNum;
+		}
+		else {
+			ExternalSorter::AppendRecord(chunk, k, v);
+		}
+		written++;
+		if (chunk.size() >= chunkBytes) {
+			int ret = flush();
+			return ret == TXO_OK ? 0 : ret;
+		}
+		return 0;
+	});
+	if (err == 0) {
+		addChunk();
+		addBalance();
+		addStatus();
+		if ((err = flush()) == TXO_OK) {
+			err = 0;
+		}
+	}
+	if (err != 0) {
+		spdlog::error("Bulk load of {} failed", sorter.Name());
+		return err;
+	}
+
+	if (skipped > 0) {
+		spdlog::warn("Skipped {:n} duplicate records in {}", skipped, sorter.Name());
+	}
+	spdlog::info("Wrote {:n} records to {}", written - skipped, sorter.Name());
+	return TXO_OK;
+}
+
+void TXODB::PreLoadBlocks(std::string path, const PreloadOptions& opts) {
+	spdlog::info("Preload starting.. this will take some time.");
+
+	mdb_env_set_flags(this->env, MDB_NOSYNC, 1);
+
+	std::vector<std::filesystem::path> blks;
+	for (auto& entry : std::filesystem::directory_iterator(path)) {
+		if (entry.path().filename().string().find("blk") == 0) {
+			blks.push_back(entry.path());
+		}
+	}
+	std::sort(blks.begin(), blks.end());
+
+	auto nRead = std::max(1u, opts.readThreads);
+	auto nParse = std::max(1u, opts.parseThreads);
+	auto nHash = opts.hashThreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : opts.hashThreads;
+	auto depth = std::max(1u, opts.queueDepth);
+	auto commitBlocks = std::max(1u, opts.commitBlocks);
+	auto commitBytes = (uint64_t)std::max(1u, opts.commitMB) * 1024 * 1024;
+	spdlog::info("Preload pipeline: {} read, {} parse, {} hash threads, 1 writer (queue depth {})", nRead, nParse, nHash, depth);
+	spdlog::info("Committing every {} blocks or {} MB, caching {} outputs", commitBlocks, commitBytes / 1024 / 1024, opts.cacheOutputs);
+
+	//the undo data has the value and scriptHash of outputs spent after they left the cache,
+	//without it those spends could not be taken off a balance or added to a status
+	if (!opts.undo) {
+		spdlog::error("Preload needs the undo data (preload_undo) to index balances and statuses");
+		return;
+	}
+
+	MDB_txn* txn;
+	MDB_stat st_addr, st_txo, st_blk, st_txnum, st_addrid, st_height, st_spend, st_balance, st_status;
+	if (mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn");
+		return;
+	}
+	mdb_stat(txn, this->dbi_addr, &st_addr);
+	mdb_stat(txn, this->dbi_txo, &st_txo);
+	mdb_stat(txn, this->dbi_blk, &st_blk);
+	mdb_stat(txn, this->dbi_txnum, &st_txnum);
+	mdb_stat(txn, this->dbi_addrid, &st_addrid);
+	mdb_stat(txn, this->dbi_height, &st_height);
+	mdb_stat(txn, this->dbi_spend, &st_spend);
+	mdb_stat(txn, this->dbi_balance, &st_balance);
+	mdb_stat(txn, this->dbi_status, &st_status);
+	mdb_txn_abort(txn);
+
+	//balances are added onto and statuses appended to, loading blocks that are
+	//already in would count them twice and break the status chain
+	if (!opts.bulk && (st_balance.ms_entries > 0 || st_status.ms_entries > 0)) {
+		spdlog::error("Preload needs a database without balances or statuses, blocks are already loaded");
+		return;
+	}
+
+	//MDB_APPEND only works on the end of a tree, so bulk mode needs empty dbis
+	std::unique_ptr<PreloadSorters> sorters;
+	if (opts.bulk) {
+		if (st_addr.ms_entries > 0 || st_txo.ms_entries > 0 || st_blk.ms_entries > 0 || st_txnum.ms_entries > 0 || st_addrid.ms_entries > 0 || st_height.ms_entries > 0 || st_spend.ms_entries > 0 || st_balance.ms_entries > 0 || st_status.ms_entries > 0) {
+			spdlog::error("Bulk preload needs an empty database");
+			return;
+		}
+
+		auto sortDir = opts.sortDir.empty() ? this->dbPath + ".sort" : opts.sortDir;
+		std::error_code ec;
+		std::filesystem::create_directories(sortDir, ec);
+		if (ec) {
+			spdlog::error("Failed to create sort dir {}: {}", sortDir, ec.message());
+			return;
+		}
+
+		auto sortBytes = (uint64_t)std::max(64u, opts.sortMB) * 1024 * 1024;
+		sorters = std::make_unique<PreloadSorters>(sortDir, sortBytes);
+		spdlog::info("Bulk preload: sorting with {} MB in {}", sortBytes / 1024 / 1024, sortDir);
+	}
+
+	//headers first, blocks are then read in height order
+	std::vector<PreloadBlockPos> chain;
+	if (!PreloadBestChain(blks, std::max(nRead, nHash), chain)) {
+		return;
+	}
+	PreloadFiles files(blks, chain);
+
+	BoundedQueue<RawBlock> q_raw(depth);
+	BoundedQueue<ParsedBlock> q_parsed(depth);
+	BoundedQueue<IndexedBlock> q_indexed(depth);
+
+	std::atomic<uint32_t> nextHeight = 0;
+	std::atomic<bool> failed = false;
+
+	//blocks finish hashing out of order and wait in the writer until the blocks
+	//below them are connected. readers stay within window of the writer,
+	//so the blocks waiting there are bounded like the queues
+	auto window = depth * 3 + nRead + nParse + nHash;
+	uint32_t connected = 0;
+	std::mutex window_lock;
+	std::condition_variable window_cv;
+
+	auto abort = [&] {
+		{
+			std::lock_guard<std::mutex> lk(window_lock);
+			failed = true;
+		}
+		window_cv.notify_all();
+		q_raw.Close();
+		q_parsed.Close();
+		q_indexed.Close();
+	};
+
+	std::vector<std::thread> readers;
+	for (uint32_t x = 0; x < nRead; x++) {
+		readers.emplace_back([&] {
+			uint32_t h;
+			while (!failed && (h = nextHeight++) < chain.size()) {
+				{
+					std::unique_lock<std::mutex> lk(window_lock);
+					window_cv.wait(lk, [&] { return failed || h < connected + window; });
+				}
+				if (failed) {
+					break;
+				}
+				const auto& pos = chain[h];
+
+				RawBlock raw;
+				if (!files.Get(pos.file, raw.file, raw.undo)) {
+					abort();
+					break;
+				}
+				raw.data = raw.file->data() + pos.offset;
+				raw.size = pos.size;
+				raw.height = h;
+				if (!q_raw.Push(std::move(raw))) {
+					break;
+				}
+			}
+		});
+	}
+
+	std::vector<std::thread> parsers;
+	for (uint32_t x = 0; x < nParse; x++) {
+		parsers.emplace_back([&] {
+			RawBlock raw;
+			while (q_raw.Pop(raw)) {
+				ParsedBlock parsed;
+				bool ok = PreloadParseBlock(raw, parsed);
+				if (!ok) {
+					//the writer would wait for this height forever
+					abort();
+					break;
+				}
+				if (!q_parsed.Push(std::move(parsed))) {
+					break;
+				}
+			}
+		});
+	}
+
+	std::vector<std::thread> hashers;
+	for (uint32_t x = 0; x < nHash; x++) {
+		hashers.emplace_back([&] {
+			ParsedBlock parsed;
+			PreloadScripts scripts;
+			Arena arena;
+			while (q_parsed.Pop(parsed)) {
+				IndexedBlock idx;
+				if (!PreloadHashBlock(parsed, scripts, arena, idx, opts.checkMerkle)) {
+					//the writer would wait for this height forever
+					abort();
+				}
+				parsed.file.reset(); //unmap once all blocks of a file are hashed
+				parsed.undo.reset();
+				if (!q_indexed.Push(std::move(idx))) {
+					break;
+				}
+			}
+		});
+	}
+
+	//LMDB has a single writer, so only one thread ever writes.
+	//Blocks are connected in height order, so every spend comes after its output
+	std::thread writer([&] {
+		uint64_t rate_tx_process = 0, rate_block_process = 0;
+		uint64_t total_tx_process = 0, total_block_process = 0;
+		uint64_t cache_hits = 0, cache_misses = 0;
+		auto rate_last_print = std::chrono::system_clock::now();
+
+		//blocks that finished hashing before the block below them
+		std::map<uint32_t, IndexedBlock> pending;
+		uint32_t nextConnect = 0;
+
+		PreloadOutputCache cache(opts.cacheOutputs);
+		PreloadBatch batch;
+		uint32_t batchBlocks = 0;
+		uint64_t syncBytes = 0;
+
+		//txs are numbered in chain order from genesis, loading the same chain
+		//again gives every tx the same number
+		uint64_t nextTxNum = 0;
+
+		auto flush = [&] {
+			if (batch.headers.empty() && batch.txids.empty() && batch.outputs.empty() && batch.spentOutputs.empty()) {
+				return true;
+			}
+			if (sorters) {
+				if (PreloadSpillBatch(batch, *sorters, this->addrKeyBytes)) {
+					spdlog::error("Preload sort failed, stopping..");
+					abort();
+					return false;
+				}
+			}
+			else {
+				if (this->PreloadWriteBatch(batch) != TXO_OK) {
+					spdlog::error("Preload writer failed, stopping..");
+					abort();
+					return false;
+				}
+				if (batch.sync) {
+					mdb_env_sync(this->env, 1);//make sure to force sync here!
+					syncBytes = 0;
+				}
+			}
+
+			batch.clear();
+			batchBlocks = 0;
+			return true;
+		};
+
+		auto connect = [&](IndexedBlock& blk) {
+			batch.headers.emplace_back(blk.hash, blk.header);
+
+			if (batch.txids.empty()) {
+				batch.firstTxNum = nextTxNum;
+			}
+			batch.heights.emplace_back(blk.height, nextTxNum);
+			batch.txids.insert(batch.txids.end(), blk.txids.begin(), blk.txids.end());
+
+			//outputs first, inputs can spend outputs of the same block
+			for (auto& t : blk.outputs) {
+				t.height = blk.height;
+				t.txNum += nextTxNum;
+				cache.Add(t);
+				batch.history.push_back({ t.scriptHash, t.txHash, t.txNum, blk.height, t.n });
+			}
+			auto blockTxNum = nextTxNum;
+			nextTxNum += blk.txids.size();
+			for (size_t x = 0; x < blk.spends.size(); x++) {
+				const auto& spend = blk.spends[x];
+				auto spendTxNum = blockTxNum + blk.spendTxs[x];
+				if (cache.Spend(spend.first, spend.second, batch.outputs)) {
+					cache_hits++;
+					batch.history.push_back({ batch.outputs.back().scriptHash, spend.second.hash, spendTxNum, blk.height, spend.second.n | TXORef::INPUT });
+				}
+				else if (!blk.spentOutputs.empty()) {
+					cache_misses++;
+					batch.history.push_back({ blk.spentOutputs[x].scriptHash, spend.second.hash, spendTxNum, blk.height, spend.second.n | TXORef::INPUT });
+					batch.spentOutputs.push_back(std::move(blk.spentOutputs[x]));
+				}
+				else {
+					//nothing says whose balance this spend takes from
+					spdlog::error("No spent output for {}:{} in block {}", spend.first.hash.GetHex(), spend.first.n, blk.hash.GetHex());
+					return false;
+				}
+			}
+			cache.Evict(batch.outputs);
+
+			syncBytes += blk.size;
+			batch.sync |= syncBytes >= PRELOAD_SYNC_BYTES;
+			batchBlocks++;
+			return true;
+		};
+
+		IndexedBlock idx;
+		while (q_indexed.Pop(idx)) {
+			rate_block_process++;
+			total_block_process++;
+			rate_tx_process += idx.ntx;
+			total_tx_process += idx.ntx;
+
+			pending.emplace(idx.height, std::move(idx));
+			for (auto it = pending.begin(); it != pending.end() && it->first == nextConnect; it = pending.erase(it)) {
+				if (!connect(it->second)) {
+					abort();
+					break;
+				}
+				nextConnect++;
+			}
+			if (failed) {
+				break;
+			}
+			{
+				std::lock_guard<std::mutex> lk(window_lock);
+				connected = nextConnect;
+			}
+			window_cv.notify_all();
+
+			batch.bytes = batch.outputs.size() * PRELOAD_OUTPUT_BYTES + batch.spentOutputs.size() * PRELOAD_SPEND_BYTES + batch.headers.size() * (32 + 80) + batch.txids.size() * PRELOAD_TXNUM_BYTES + batch.heights.size() * (4 + TXNUM_SIZE) + batch.history.size() * PRELOAD_HISTORY_BYTES;
+			if ((batchBlocks >= commitBlocks || batch.bytes >= commitBytes) && !flush()) {
+				break;
+			}
+
+			std::chrono::duration<double> nt = std::chrono::system_clock::now() - rate_last_print;
+			if (nt.count() >= 5) {
+				spdlog::info("{:n} blk/s, {:n} txo/s, {:n} txn, {:n} blk, height {:n} (queues: {} raw, {} parsed, {} hashed)", (uint64_t)(rate_block_process / nt.count()), (uint64_t)(rate_tx_process / nt.count()), total_tx_process, total_block_process, nextConnect, q_raw.Size(), q_parsed.Size(), q_indexed.Size());
+				spdlog::info("Output cache: {:n} cached, {:.2f}% hits, {} blocks waiting", cache.Size(), 100.0 * ((double)cache_hits / (double)std::max(1ull, (unsigned long long)(cache_hits + cache_misses))), pending.size());
+				rate_block_process = 0;
+				rate_tx_process = 0;
+				rate_last_print = std::chrono::system_clock::now();
+			}
+		}
+
+		if (!failed) {
+			//whatever is still unspent goes in with the last batch
+			cache.Drain(batch.outputs);
+			flush();
+		}
+	});
+
+	//close each queue once every producer of that stage is done
+	for (auto& t : readers) {
+		t.join();
+	}
+	q_raw.Close();
+	for (auto& t : parsers) {
+		t.join();
+	}
+	q_parsed.Close();
+	for (auto& t : hashers) {
+		t.join();
+	}
+	q_indexed.Close();
+	writer.join();
+
+	mdb_env_sync(this->env, 1);
+	if (failed) {
+		spdlog::error("Preload failed!");
+		return;
+	}
+
+	if (sorters) {
+		//every dbi is merged and appended in key order, one after the other,
+		//nothing is read back, so the order of the dbis does not matter
+		for (auto s : { std::make_pair(&sorters->blk, this->dbi_blk), std::make_pair(&sorters->txnum, this->dbi_txnum), std::make_pair(&sorters->height, this->dbi_height), std::make_pair(&sorters->addr, this->dbi_addr), std::make_pair(&sorters->addrid, this->dbi_addrid), std::make_pair(&sorters->txo, this->dbi_txo), std::make_pair(&sorters->spend, this->dbi_spend), std::make_pair(&sorters->balance, this->dbi_balance), std::make_pair(&sorters->status, this->dbi_status) }) {
+			spdlog::info("Sorting {} ({:n} records, {:n} MB)", s.first->Name(), s.first->Count(), s.first->Bytes() / 1024 / 1024);
+			auto records = s.first == &sorters->addrid ? BulkRecords::AddrIds
+				: s.first == &sorters->addr ? BulkRecords::Postings
+				: s.first == &sorters->balance ? BulkRecords::Balances
+				: s.first == &sorters->status ? BulkRecords::Status
+				: BulkRecords::Append;
+			if (s.first->Finish() || this->BulkAppend(*s.first, s.second, commitBytes, records) != TXO_OK) {
+				spdlog::error("Preload failed!");
+				return;
+			}
+			s.first->Clear();
+			mdb_env_sync(this->env, 1);
+		}
+		sorters.reset();
+	}
+
+	spdlog::info("Preload finished!");
+}
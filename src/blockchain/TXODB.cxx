@@ -7,7 +7,10 @@
 #include <electrumz/bitcoin/streams.h>
 #include <electrumz/bitcoin/util_strencodings.h>
 
+#include <algorithm>
+#include <array>
 #include <filesystem>
+#include <iterator>
 #include <fstream>
 #include <stdio.h>
 #include <sstream>
@@ -19,10 +22,22 @@ using namespace electrumz;
 using namespace electrumz::blockchain;
 
 constexpr size_t MAPSIZE_BASE_UNIT = 1024 * 1024 * 100;
-#define PRELOAD_BUFFER_SIZE 0x8000000 //load full blockfiles in RAM, this is called "MAX_BLOCKFILE_SIZE" in Bitcoin Core
 
-TXODB::TXODB(std::string path) {
+int electrumz::blockchain::TXOCompare(const MDB_val* a, const MDB_val* b) {
+	//first member of a TXO is its N index, use this to sort the outputs.
+	//inputs have the high bit set, so the difference would not fit an int
+	uint32_t* an = (uint32_t*)a->mv_data;
+	uint32_t* bn = (uint32_t*)b->mv_data;
+	return *an < *bn ? -1 : *an > *bn ? 1 : 0;
+}
+
+TXODB::TXODB(std::string path, uint32_t addrKeyBytes) {
 	this->dbPath = path;
+	this->addrKeyBytes = addrKeyBytes;
+	if (addrKeyBytes < ADDR_KEY_MIN || addrKeyBytes > ADDR_KEY_MAX) {
+		this->addrKeyBytes = std::min<uint32_t>(std::max<uint32_t>(addrKeyBytes, ADDR_KEY_MIN), ADDR_KEY_MAX);
+		spdlog::warn("Addr keys can be {}-{} bytes, using {}", ADDR_KEY_MIN, ADDR_KEY_MAX, this->addrKeyBytes);
+	}
 }
 
 int TXODB::Open() {
@@ -31,7 +46,7 @@ int TXODB::Open() {
 		spdlog::error("mdb create failed {}", mdb_strerror(err));
 		return err;
 	}
-	if (err = mdb_env_set_maxdbs(this->env, 3)) {
+	if (err = mdb_env_set_maxdbs(this->env, 9)) {
 		spdlog::error("Failed to set max dbs: {}", mdb_strerror(err));
 		return err;
 	}
@@ -55,6 +70,147 @@ int TXODB::Open() {
 		}
 	}
 
+	return this->OpenDBIs();
+}
+
+/// MDB_INCOMPATIBLE if the first record of a dbi is not size bytes, a db of an older layout
+static int OpenDBICheckSize(MDB_txn* txn, MDB_dbi dbi, const char* name, size_t size) {
+	int err = 0;
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, dbi, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		return err;
+	}
+	MDB_val key, val;
+	err = mdb_cursor_get(cur, &key, &val, MDB_FIRST);
+	mdb_cursor_close(cur);
+	if (err == 0 && val.mv_size != size) {
+		spdlog::error("The {} dbi has {} byte records instead of {}, delete the db and preload it again", name, val.mv_size, size);
+		return MDB_INCOMPATIBLE;
+	}
+	else if (err != 0 && err != MDB_NOTFOUND) {
+		spdlog::error("Failed to read {}: {}", name, mdb_strerror(err));
+		return err;
+	}
+	return 0;
+}
+
+int TXODB::OpenDBIs() {
+	int err = 0;
+	MDB_txn* txn;
+	if (err = mdb_txn_begin(this->env, nullptr, 0, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
+
+	if (err = mdb_dbi_open(txn, DBI_TXO, MDB_CREATE | MDB_DUPSORT, &this->dbi_txo)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_TXO, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	// Add dupsort for txo, handles stay open for the life of the env so this is only set once.
+	// It has to be set before anything in the dbi is read
+	if (err = mdb_set_dupsort(txn, this->dbi_txo, TXOCompare)) {
+		spdlog::error("Failed to set cmpfunc for dbi {}: {}", DBI_TXO, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	//posting list chunks, one key per chunk instead of a dup per output
+	if (err = mdb_dbi_open(txn, DBI_ADDR, MDB_CREATE, &this->dbi_addr)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_ADDR, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	unsigned int addrFlags = 0;
+	if ((err = mdb_dbi_flags(txn, this->dbi_addr, &addrFlags)) == 0 && (addrFlags & MDB_DUPSORT)) {
+		spdlog::error("The {} dbi stores an output per dup, delete the db and preload it again", DBI_ADDR);
+		err = MDB_INCOMPATIBLE;
+	}
+	if (err) {
+		mdb_txn_abort(txn);
+		return err;
+	}
+
+	//the key size is fixed once the first key is stored
+	MDB_cursor* cur_addr;
+	if (err = mdb_cursor_open(txn, this->dbi_addr, &cur_addr)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	MDB_val first_key, first_val;
+	err = mdb_cursor_get(cur_addr, &first_key, &first_val, MDB_FIRST);
+	mdb_cursor_close(cur_addr);
+	if (err == 0) {
+		auto keyBytes = first_key.mv_size - FixedCodec<TXORef>::Size;
+		if (first_key.mv_size < FixedCodec<TXORef>::Size || keyBytes < ADDR_KEY_MIN || keyBytes > ADDR_KEY_MAX) {
+			spdlog::error("Bad {} key size {}", DBI_ADDR, first_key.mv_size);
+			mdb_txn_abort(txn);
+			return MDB_CORRUPTED;
+		}
+		if (keyBytes != this->addrKeyBytes) {
+			spdlog::warn("The {} dbi is keyed by {} byte scriptHash prefixes, ignoring the configured {}", DBI_ADDR, keyBytes, this->addrKeyBytes);
+			this->addrKeyBytes = (uint32_t)keyBytes;
+		}
+	}
+	else if (err != MDB_NOTFOUND) {
+		spdlog::error("Failed to read {}: {}", DBI_ADDR, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	err = 0;
+
+	//spends moved out of the txo records, records of an older layout are bigger
+	if (err = OpenDBICheckSize(txn, this->dbi_txo, DBI_TXO, TXORecord::Size(this->addrKeyBytes))) {
+		mdb_txn_abort(txn);
+		return err;
+	}
+
+	if (err = mdb_dbi_open(txn, DBI_BLK, MDB_CREATE, &this->dbi_blk)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_BLK, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_TXNUM, MDB_CREATE, &this->dbi_txnum)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_TXNUM, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	//the height was added next to the txid
+	if (err = OpenDBICheckSize(txn, this->dbi_txnum, DBI_TXNUM, TXNUM_RECORD_SIZE)) {
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_ADDRID, MDB_CREATE, &this->dbi_addrid)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_ADDRID, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_HEIGHT, MDB_CREATE, &this->dbi_height)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_HEIGHT, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_SPEND, MDB_CREATE, &this->dbi_spend)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_SPEND, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_BALANCE, MDB_CREATE, &this->dbi_balance)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_BALANCE, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_dbi_open(txn, DBI_STATUS, MDB_CREATE, &this->dbi_status)) {
+		spdlog::error("Failed to open dbi {}: {}", DBI_STATUS, mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+
+	if (err = mdb_txn_commit(txn)) {
+		spdlog::error("Failed to commit dbi open: {}", mdb_strerror(err));
+		return err;
+	}
 	return err;
 }
 
@@ -74,552 +230,792 @@ int TXODB::GetTXOStats(MDB_stat* stats, const char* dbn) {
 	return err;
 }
 
-int TXODB::GetTXOs(uint256 scriptHash, std::vector<TXO>& ntx) {
+int TXODB::GetHeightTxNum(MDB_txn* txn, uint32_t height, uint64_t& txNum) {
 	int err = 0;
-	MDB_txn* txn;
-	MDB_dbi dbi;
-	if (!(err = StartTXOTxn(&txn, DBI_ADDR, dbi))) {
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_height, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
 		return err;
 	}
 
-	MDB_val key{
-		scriptHash.size(),
-		scriptHash.begin()
+	unsigned char height_buf[4];
+	WriteBE32(height_buf, height);
+	MDB_val key = {
+		sizeof(height_buf),
+		height_buf
 	};
-
 	MDB_val val;
-	err = mdb_get(txn, dbi, &key, &val);
+
+	//heights without a block are skipped to the next one stored
+	err = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+	if (err == 0 && val.mv_size != TXNUM_SIZE) {
+		err = MDB_CORRUPTED;
+	}
+	if (err == 0) {
+		txNum = ReadTxNum((const unsigned char*)val.mv_data);
+	}
+	mdb_cursor_close(cur);
+
 	if (err == MDB_NOTFOUND) {
+		return TXO_NOTFOUND;
+	}
+	else if (err != 0) {
+		spdlog::error("Failed to get first tx of height {}: {}", height, mdb_strerror(err));
+		return err;
+	}
+	return TXO_OK;
+}
+
+int TXODB::GetTXOs(uint256 scriptHash, std::vector<TXO>& ntx, uint32_t fromHeight) {
+	int err = 0;
+	MDB_txn* txn;
+	MDB_cursor* cur_txnum;
+	MDB_cursor* cur_txo;
+
+	if (err = mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
+	//tx numbers are in chain order, so a height is a place in the posting list
+	TXORef from;
+	if (fromHeight > 0) {
+		err = this->GetHeightTxNum(txn, fromHeight, from.txNum);
+		if (err == TXO_NOTFOUND) {
+			mdb_txn_abort(txn);
+			return TXO_OK;
+		}
+		else if (err != TXO_OK) {
+			mdb_txn_abort(txn);
+			return err;
+		}
+	}
+
+	auto start = ntx.size();
+	std::vector<TXORef> refs;
+	if ((err = this->ReadAddrRefs(txn, scriptHash, from, refs)) != TXO_OK) {
 		mdb_txn_abort(txn);
-		return TXO_NOTFOUND; //not found, (1 is ok)
+		return err;
 	}
-	else if (err == EINVAL) {
+	if (refs.empty()) {
+		mdb_txn_abort(txn);
+		return fromHeight > 0 ? TXO_OK : TXO_NOTFOUND;
+	}
+
+	if (err = mdb_cursor_open(txn, this->dbi_txnum, &cur_txnum)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_cursor_open(txn, this->dbi_txo, &cur_txo)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_cursor_close(cur_txnum);
 		mdb_txn_abort(txn);
-		spdlog::error("Error getting txos {}", mdb_strerror(err));
 		return err;
 	}
-	else {
-		COutPoint outPoint;
-		spdlog::debug("Got val for {}: {}", HexStr(scriptHash), HexStr((char*)val.mv_data, (char*)val.mv_data + val.mv_size));
 
-		CDataStream ds((char*)val.mv_data, (char*)val.mv_data + val.mv_size, SER_DISK, PROTOCOL_VERSION);
-		outPoint.Unserialize(ds);
+	//refs are in chain order, so the txnum cursor only moves forward and
+	//outputs of the same tx share one lookup
+	auto txoSize = TXORecord::Size(this->addrKeyBytes);
+	uint256 txHash;
+	uint64_t txNum = 0;
+	bool haveTx = false;
+	ntx.reserve(ntx.size() + refs.size());
+	for (const auto& ref : refs) {
+		//spends are joined from DBI_SPEND
+		if (ref.IsInput()) {
+			continue;
+		}
+		if (!haveTx || ref.txNum != txNum) {
+			unsigned char num_buf[TXNUM_SIZE];
+			WriteTxNum(num_buf, ref.txNum);
+			MDB_val num_key = {
+				sizeof(num_buf),
+				num_buf
+			};
+			MDB_val num_val;
+
+			err = mdb_cursor_get(cur_txnum, &num_key, &num_val, MDB_SET);
+			if (err == 0 && num_val.mv_size != TXNUM_RECORD_SIZE) {
+				err = MDB_CORRUPTED;
+			}
+			if (err != 0) {
+				spdlog::error("Failed to get txid of tx {} for {}: {}", ref.txNum, HexStr(scriptHash), mdb_strerror(err));
+				goto txos_failed;
+			}
+			memcpy(txHash.begin(), num_val.mv_data, txHash.size());
+			txNum = ref.txNum;
+			haveTx = true;
+		}
 
-		mdb_txn_commit(txn);
-		return TXO_OK;
+		MDB_val tx_key = {
+			txHash.size(),
+			txHash.begin()
+		};
+		uint32_t n = ref.n;
+		MDB_val tx_val = {
+			sizeof(n),
+			&n
+		};
+
+		err = mdb_cursor_get(cur_txo, &tx_key, &tx_val, MDB_GET_BOTH);
+		if (err == MDB_NOTFOUND) {
+			spdlog::warn("Missing txo {}:{} for {}", txHash.GetHex(), ref.n, HexStr(scriptHash));
+			continue;
+		}
+		else if (err == 0 && tx_val.mv_size != txoSize) {
+			err = MDB_CORRUPTED;
+		}
+		if (err != 0) {
+			spdlog::error("Failed to get txo {}:{} {}", txHash.GetHex(), ref.n, mdb_strerror(err));
+			goto txos_failed;
+		}
+
+		//an output of another scriptHash with the same key prefix
+		if (!TXORecord::Matches((const unsigned char*)tx_val.mv_data, scriptHash, this->addrKeyBytes)) {
+			continue;
+		}
+
+		TXO txo;
+		FixedCodec<TXO>::Read((const unsigned char*)tx_val.mv_data, txo);
+		txo.txHash = txHash;
+		txo.scriptHash = scriptHash;
+		txo.txNum = ref.txNum;
+		ntx.push_back(txo);
 	}
+	err = this->JoinSpends(txn, ntx, start);
+
+txos_failed:
+	mdb_cursor_close(cur_txo);
+	mdb_cursor_close(cur_txnum);
+	mdb_txn_abort(txn);
+	return err;
 }
 
-int TXODB::IncreaseMapSize() {
-	std::lock_guard<std::mutex> x(this->resize_lock);
+int TXODB::ReadHistory(uint256 scriptHash, uint64_t from, size_t max, const std::function<void(const uint256& txid, uint32_t height)>& f, std::optional<uint64_t>& next) {
 	int err = 0;
-	struct MDB_envinfo current_info;
-	if (err = mdb_env_info(this->env, &current_info)) {
-		spdlog::error("Failed to get env info for resize: {}", mdb_strerror(err));
+	MDB_txn* txn;
+	MDB_cursor* cur_addr;
+	MDB_cursor* cur_txnum;
+	MDB_cursor* cur_txo;
+
+	if (err = mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
+	if (err = mdb_cursor_open(txn, this->dbi_addr, &cur_addr)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_cursor_open(txn, this->dbi_txnum, &cur_txnum)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_cursor_close(cur_addr);
+		mdb_txn_abort(txn);
+		return err;
+	}
+	if (err = mdb_cursor_open(txn, this->dbi_txo, &cur_txo)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		mdb_cursor_close(cur_txnum);
+		mdb_cursor_close(cur_addr);
+		mdb_txn_abort(txn);
 		return err;
 	}
 
-	size_t new_size = (current_info.me_mapsize - (current_info.me_mapsize % MAPSIZE_BASE_UNIT)) + MAPSIZE_BASE_UNIT;
-	spdlog::info("Setting mapsize to {}", new_size);
-	if (err = mdb_env_set_mapsize(this->env, new_size)) {
-		spdlog::error("Failed to resize map: {}", mdb_strerror(err));
+	//a full key holds one scriptHash, a prefix key needs the txo tail to tell
+	//its outputs and inputs apart
+	bool checkTail = this->addrKeyBytes < ADDR_KEY_MAX;
+	auto txoSize = TXORecord::Size(this->addrKeyBytes);
+
+	size_t count = 0;
+	uint64_t lastTx = 0;
+	bool haveTx = false;
+	next.reset();
+
+	std::vector<TXORef> refs;
+	MDB_val key, val;
+	err = this->SeekAddrChunk(cur_addr, scriptHash, TXORef(from, 0), key, val);
+	while (err == 0 && this->IsAddrChunk(key, scriptHash)) {
+		TXORef first;
+		FixedCodec<TXORef>::Read((const unsigned char*)key.mv_data + this->addrKeyBytes, first);
+
+		refs.clear();
+		if (!TXORefChunk::Decode(first, (const unsigned char*)val.mv_data, val.mv_size, refs)) {
+			spdlog::error("Bad addr chunk for {}", HexStr(scriptHash));
+			err = MDB_CORRUPTED;
+			break;
+		}
+
+		for (const auto& ref : refs) {
+			//a tx paying or spending more than one output is in the history once
+			if (ref.txNum < from || (haveTx && ref.txNum == lastTx)) {
+				continue;
+			}
+
+			unsigned char num_buf[TXNUM_SIZE];
+			WriteTxNum(num_buf, ref.txNum);
+			MDB_val num_key = {
+				sizeof(num_buf),
+				num_buf
+			};
+			MDB_val num_val;
+
+			err = mdb_cursor_get(cur_txnum, &num_key, &num_val, MDB_SET);
+			if (err == 0 && num_val.mv_size != TXNUM_RECORD_SIZE) {
+				err = MDB_CORRUPTED;
+			}
+			if (err != 0) {
+				spdlog::error("Failed to get txid of tx {} for {}: {}", ref.txNum, HexStr(scriptHash), mdb_strerror(err));
+				goto history_done;
+			}
+			uint256 txid;
+			memcpy(txid.begin(), num_val.mv_data, txid.size());
+
+			if (checkTail) {
+				MDB_val tx_key = {
+					txid.size(),
+					txid.begin()
+				};
+				uint32_t n = ref.n;
+				MDB_val tx_val = {
+					sizeof(n),
+					&n
+				};
+
+				err = mdb_cursor_get(cur_txo, &tx_key, &tx_val, MDB_GET_BOTH);
+				if (err == 0 && tx_val.mv_size != txoSize) {
+					err = MDB_CORRUPTED;
+				}
+				if (err == MDB_NOTFOUND || (err == 0 && !TXORecord::Matches((const unsigned char*)tx_val.mv_data, scriptHash, this->addrKeyBytes))) {
+					//an output or input of another scriptHash with the same key prefix
+					err = 0;
+					continue;
+				}
+				else if (err != 0) {
+					spdlog::error("Failed to get txo {}:{} {}", txid.GetHex(), ref.n, mdb_strerror(err));
+					goto history_done;
+				}
+			}
+
+			//the page is full, resume at the next tx that is really in the history
+			if (count == max) {
+				next = ref.txNum;
+				goto history_done;
+			}
+
+			f(txid, ReadLE32((const unsigned char*)num_val.mv_data + 32));
+			lastTx = ref.txNum;
+			haveTx = true;
+			count++;
+		}
+		err = mdb_cursor_get(cur_addr, &key, &val, MDB_NEXT);
+	}
+	if (err == MDB_NOTFOUND) {
+		err = 0;
+	}
+	else if (err != 0) {
+		spdlog::error("Failed to read history of {}: {}", HexStr(scriptHash), mdb_strerror(err));
+	}
+
+history_done:
+	mdb_cursor_close(cur_txo);
+	mdb_cursor_close(cur_txnum);
+	mdb_cursor_close(cur_addr);
+	mdb_txn_abort(txn);
+	return err == 0 ? TXO_OK : err;
+}
+
+int TXODB::GetUnspent(uint256 scriptHash, std::vector<TXO>& utxos) {
+	std::vector<TXO> txos;
+	int err = this->GetTXOs(scriptHash, txos);
+	if (err != TXO_OK) {
 		return err;
 	}
-	return TXO_RESIZED;
+	for (auto& txo : txos) {
+		if (txo.spend.IsNull()) {
+			utxos.push_back(std::move(txo));
+		}
+	}
+	return TXO_OK;
 }
 
-int TXODB::StartTXOTxn(MDB_txn** txn, const char* dbn, MDB_dbi& dbi) {
+int TXODB::GetBalance(uint256 scriptHash, AddrBalance& balance) {
 	int err = 0;
-	if (err = mdb_txn_begin(this->env, nullptr, 0, txn)) {
-		spdlog::error("Failed to start txo: {}", mdb_strerror(err));
+	MDB_txn* txn;
+
+	if (err = mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
 		return err;
 	}
 
-	if (err = mdb_dbi_open(*txn, dbn, MDB_CREATE, &dbi)) {
-		spdlog::error("Failed to open dbi {}: {}", dbn, mdb_strerror(err));
-		err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
-		return err;
+	MDB_val key = {
+		scriptHash.size(),
+		(void*)scriptHash.begin()
+	};
+	MDB_val val;
+
+	balance = AddrBalance();
+	err = mdb_get(txn, this->dbi_balance, &key, &val);
+	if (err == 0 && val.mv_size != FixedCodec<AddrBalance>::Size) {
+		err = MDB_CORRUPTED;
 	}
+	if (err == 0) {
+		FixedCodec<AddrBalance>::Read((const unsigned char*)val.mv_data, balance);
+	}
+	mdb_txn_abort(txn);
 
+	if (err == MDB_NOTFOUND) {
+		return TXO_NOTFOUND;
+	}
+	else if (err != 0) {
+		spdlog::error("Failed to get balance of {}: {}", HexStr(scriptHash), mdb_strerror(err));
+		return err;
+	}
 	return TXO_OK;
 }
 
-
-int TXODB::InternalSpendTXO(COutPoint& prevout, COutPoint& spendingTx) {
-	//std::scoped_lock txo_lock(this->txdbMutex, this->i2aMutex);
-	/*int err = 0;
-	MDB_txn *txn;
-	MDB_dbi dbi;
-	if (err = mdb_txn_begin(this->env, nullptr, 0, &txn)) {
-		spdlog::error("Failed to start txo: {}", mdb_strerror(err));
+int TXODB::AddBalances(MDB_txn* txn, const std::map<uint256, AddrBalance>& changes) {
+	int err = 0;
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_balance, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
 		return err;
 	}
 
-	if (err = mdb_dbi_open(txn, TXO_DBI, MDB_CREATE, &dbi)) {
-		spdlog::error("Failed to open dbi {}: {}", TXO_DBI, mdb_strerror(err));
-		err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
+	unsigned char bal_buf[FixedCodec<AddrBalance>::Size];
+	for (const auto& change : changes) {
+		MDB_val key = {
+			change.first.size(),
+			(void*)change.first.begin()
+		};
+		MDB_val val;
+
+		AddrBalance balance;
+		err = mdb_cursor_get(cur, &key, &val, MDB_SET);
+		if (err == 0 && val.mv_size != FixedCodec<AddrBalance>::Size) {
+			err = MDB_CORRUPTED;
+		}
+		if (err == 0) {
+			FixedCodec<AddrBalance>::Read((const unsigned char*)val.mv_data, balance);
+		}
+		else if (err != MDB_NOTFOUND) {
+			break;
+		}
+		bool found = err == 0;
+		balance += change.second;
+
+		if (balance.received == 0 && balance.spent == 0 && balance.utxos == 0) {
+			//every block paying the address was taken out again
+			err = found ? mdb_cursor_del(cur, 0) : 0;
+		}
+		else {
+			FixedCodec<AddrBalance>::Write(bal_buf, balance);
+			val = { sizeof(bal_buf), bal_buf };
+			err = mdb_cursor_put(cur, &key, &val, 0);
+		}
+		if (err != 0) {
+			break;
+		}
+	}
+	mdb_cursor_close(cur);
+
+	if (err != 0) {
+		spdlog::error("AddBalances write failed {}", mdb_strerror(err));
 		return err;
 	}
+	return TXO_OK;
+}
 
-	CDataStream ds(SER_DISK, PROTOCOL_VERSION);
-	ds << prevout;
+int TXODB::GetStatus(uint256 scriptHash, AddrStatus& status) {
+	int err = 0;
+	MDB_txn* txn;
+
+	if (err = mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
 
-	MDB_val val_addr;
-	MDB_val val_txns;
-	MDB_val key_addr = {
-		ds.size(),
-		ds.data()
+	MDB_val key = {
+		scriptHash.size(),
+		(void*)scriptHash.begin()
 	};
+	MDB_val val;
 
-	err = mdb_get(txn, dbi_i2a, &key_addr, &val_addr);
-	if(err != 0){
-		spdlog::error("UTXO database is corrupt (COutPoint {}:{} not found): {}", prevout.hash.GetHex(), prevout.n, mdb_strerror(err));
-		spdlog::error("Key hex: {}", HexStr((char*)key_addr.mv_data, (char*)key_addr.mv_data + key_addr.mv_size));
-		mdb_txn_abort(txn);
-		return err;
+	status = AddrStatus();
+	err = mdb_get(txn, this->dbi_status, &key, &val);
+	if (err == 0 && !status.Read((const unsigned char*)val.mv_data, val.mv_size)) {
+		err = MDB_CORRUPTED;
 	}
+	mdb_txn_abort(txn);
 
-	ds.clear();
-	err = mdb_get(txn, dbi, &val_addr, &val_txns);
-	if(err != 0){
-		spdlog::error("UTXO database is corrupt (Address not found): {}", mdb_strerror(err));
-		mdb_txn_abort(txn);
+	if (err == MDB_NOTFOUND) {
+		return TXO_NOTFOUND;
+	}
+	else if (err != 0) {
+		spdlog::error("Failed to get status of {}: {}", HexStr(scriptHash), mdb_strerror(err));
 		return err;
 	}
+	return TXO_OK;
+}
 
-	//de-serialize txns
-	ds.write((char*)val_txns.mv_data, val_txns.mv_size);
-	std::vector<TXO> txns;
-	ds >> txns;
+int TXODB::AppendStatus(MDB_txn* txn, const std::vector<PreloadHistoryTx>& history) {
+	int err = 0;
 
-	bool txoFound = false;
-	for(auto& txo : txns){
-		if(txo.txHash == prevout.hash && txo.n == prevout.n){
-			txoFound = true;
-			txo.spendingTxi.hash = spendingTx.hash;
-			txo.spendingTxi.n = spendingTx.n;
-			break;
-		}
+	//by scriptHash, chain order within one
+	std::vector<const PreloadHistoryTx*> sorted;
+	sorted.reserve(history.size());
+	for (const auto& h : history) {
+		sorted.push_back(&h);
 	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const PreloadHistoryTx* a, const PreloadHistoryTx* b) {
+		int cmp = a->scriptHash.Compare(b->scriptHash);
+		return cmp < 0 || (cmp == 0 && a->txNum < b->txNum);
+		});
 
-	if(!txoFound) {
-		spdlog::error("UTXO database is corrupt (Output not found for address): {}", mdb_strerror(err));
-		mdb_txn_abort(txn);
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_status, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
 		return err;
 	}
 
-	//write back updated txos
-	ds.clear();
-	ds << txns;
+	unsigned char status_buf[AddrStatus::MaxSize];
+	for (size_t x = 0; x < sorted.size();) {
+		const auto& scriptHash = sorted[x]->scriptHash;
+		MDB_val key = {
+			scriptHash.size(),
+			(void*)scriptHash.begin()
+		};
+		MDB_val val;
+
+		AddrStatus status;
+		err = mdb_cursor_get(cur, &key, &val, MDB_SET);
+		if (err == 0 && !status.Read((const unsigned char*)val.mv_data, val.mv_size)) {
+			err = MDB_CORRUPTED;
+		}
+		if (err != 0 && err != MDB_NOTFOUND) {
+			break;
+		}
+
+		//a tx paying or spending more than one output is in the history once
+		for (uint64_t last = UINT64_MAX; x < sorted.size() && sorted[x]->scriptHash == scriptHash; x++) {
+			if (sorted[x]->txNum != last) {
+				status.Append(sorted[x]->txid.GetHex(), (int32_t)sorted[x]->height);
+				last = sorted[x]->txNum;
+			}
+		}
 
-	val_txns.mv_data = ds.data();
-	val_txns.mv_size = ds.size();
+		val = { status.Write(status_buf), status_buf };
+		if (err = mdb_cursor_put(cur, &key, &val, 0)) {
+			break;
+		}
+	}
+	mdb_cursor_close(cur);
 
-	err = mdb_put(txn, dbi, &val_addr, &val_txns, MDB_NODUPDATA);
-	if (err == MDB_MAP_FULL || err == MDB_TXN_FULL || err == EINVAL || err == EACCES) {
-		spdlog::error("InternalSpendTXO write failed {}", mdb_strerror(err));
+	if (err != 0) {
+		spdlog::error("AppendStatus write failed {}", mdb_strerror(err));
+		return err;
+	}
+	return TXO_OK;
+}
 
-		mdb_txn_abort(txn);
-		err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
+int TXODB::JoinSpends(MDB_txn* txn, std::vector<TXO>& txos, size_t start) {
+	int err = 0;
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_spend, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
 		return err;
 	}
 
-	mdb_txn_commit(txn);*/
+	//outpoints as DBI_SPEND keys, in key order
+	constexpr size_t keySize = FixedCodec<COutPoint>::Size;
+	std::vector<std::pair<std::array<unsigned char, keySize>, size_t>> keys(txos.size() - start);
+	for (size_t x = start; x < txos.size(); x++) {
+		FixedCodec<COutPoint>::Write(keys[x - start].first.data(), COutPoint(txos[x].txHash, txos[x].n));
+		keys[x - start].second = x;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	//the cursor only moves forward, it seeks when it falls behind an outpoint
+	//and an outpoint it already passed is unspent
+	MDB_val key, val;
+	bool positioned = false;
+	for (const auto& k : keys) {
+		int cmp = -1;
+		if (positioned) {
+			cmp = memcmp(key.mv_data, k.first.data(), keySize);
+		}
+		if (cmp < 0) {
+			key = { keySize, (void*)k.first.data() };
+			err = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+			if (err == MDB_NOTFOUND) {
+				//nothing spent past this outpoint
+				break;
+			}
+			else if (err == 0 && (key.mv_size != keySize || val.mv_size != keySize)) {
+				err = MDB_CORRUPTED;
+			}
+			if (err != 0) {
+				spdlog::error("Failed to read {}: {}", DBI_SPEND, mdb_strerror(err));
+				mdb_cursor_close(cur);
+				return err;
+			}
+			positioned = true;
+			cmp = memcmp(key.mv_data, k.first.data(), keySize);
+		}
+		if (cmp == 0) {
+			FixedCodec<COutPoint>::Read((const unsigned char*)val.mv_data, txos[k.second].spend);
+		}
+	}
+	mdb_cursor_close(cur);
 	return TXO_OK;
 }
 
-int TXODB::InternalAddTXO(TXO& nTx, MDB_txn* txn, MDB_dbi& dbi, MDB_dbi& dbi_i2a) {
-	//std::scoped_lock txo_lock(this->txdbMutex, this->i2aMutex);
+int TXODB::GetAddrId(const uint256& scriptHash, uint32_t& id) {
 	int err = 0;
+	MDB_txn* txn;
 
-	//output point to store for this address
-	COutPoint op;
-	op.hash = nTx.txHash;
-	op.n = nTx.n;
-
-	CDataStream ds(SER_DISK, PROTOCOL_VERSION);
-	ds << op;
+	if (err = mdb_txn_begin(this->env, nullptr, MDB_RDONLY, &txn)) {
+		spdlog::error("Failed to start txn: {}", mdb_strerror(err));
+		return err;
+	}
 
-	//scriptHash(address) key
-	MDB_val addr_key{
-		nTx.scriptHash.size(),
-		nTx.scriptHash.begin()
-	};
-	MDB_val addr_val = {
-		ds.size(),
-		ds.data()
+	MDB_val key = {
+		scriptHash.size(),
+		(void*)scriptHash.begin()
 	};
+	MDB_val val;
 
-	err = mdb_put(txn, dbi, &addr_key, &addr_val, NULL);
-	if (err != 0) {
-		spdlog::error("AddTXOs write failed {}", mdb_strerror(err));
-		if (err == MDB_MAP_FULL) {
-			mdb_txn_abort(txn);
-			err = this->IncreaseMapSize();
+	err = mdb_get(txn, this->dbi_addrid, &key, &val);
+	if (err == 0 && val.mv_size != sizeof(id)) {
+		err = MDB_CORRUPTED;
+	}
+	if (err == 0) {
+		id = ReadLE32((const unsigned char*)val.mv_data);
+	}
+	mdb_txn_abort(txn);
+
+	if (err == MDB_NOTFOUND) {
+		return TXO_NOTFOUND;
+	}
+	else if (err != 0) {
+		spdlog::error("Failed to get address id of {}: {}", HexStr(scriptHash), mdb_strerror(err));
+		return err;
+	}
+	return TXO_OK;
+}
+
+int TXODB::SeekAddrChunk(MDB_cursor* cur, const uint256& scriptHash, const TXORef& from, MDB_val& key, MDB_val& val) {
+	int err = 0;
+	unsigned char seek_buf[ADDR_CHUNK_KEY_MAX];
+	MDB_val seek = this->AddrChunkKey(seek_buf, scriptHash, from);
+
+	//the first chunk starting at or after from, the one before it holds from
+	//unless from starts a chunk
+	key = seek;
+	err = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+	bool exact = err == 0 && key.mv_size == seek.mv_size && memcmp(key.mv_data, seek.mv_data, seek.mv_size) == 0;
+	if (!exact && (err == 0 || err == MDB_NOTFOUND)) {
+		MDB_val prev_key, prev_val;
+		int prev = mdb_cursor_get(cur, &prev_key, &prev_val, err == 0 ? MDB_PREV : MDB_LAST);
+		if (prev == 0 && this->IsAddrChunk(prev_key, scriptHash)) {
+			key = prev_key;
+			val = prev_val;
+			err = 0;
+		}
+		else if (prev == 0 || prev == MDB_NOTFOUND) {
+			//from comes before the first chunk
+			key = seek;
+			err = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+		}
+		else {
+			err = prev;
 		}
+	}
+	if (err == 0 && !this->IsAddrChunk(key, scriptHash)) {
+		err = MDB_NOTFOUND;
+	}
+	return err;
+}
+
+int TXODB::ReadAddrRefs(MDB_txn* txn, const uint256& scriptHash, const TXORef& from, std::vector<TXORef>& refs) {
+	int err = 0;
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_addr, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
 		return err;
 	}
 
-	//clear the datastream and store the txo
-	ds.clear();
-	ds << nTx;
+	MDB_val key, val;
+	err = this->SeekAddrChunk(cur, scriptHash, from, key, val);
+	while (err == 0 && this->IsAddrChunk(key, scriptHash)) {
+		TXORef first;
+		FixedCodec<TXORef>::Read((const unsigned char*)key.mv_data + this->addrKeyBytes, first);
 
-	//this should probably be in a seperate db
-	//but instead we rely on no hash collisions for sha256
-	//txHash <> scriptHash could collide
-	MDB_val tx_key = {
-		nTx.txHash.size(),
-		nTx.txHash.begin()
-	};
-	MDB_val tx_val = {
-		ds.size(),
-		ds.data()
-	};
+		auto start = refs.size();
+		if (!TXORefChunk::Decode(first, (const unsigned char*)val.mv_data, val.mv_size, refs)) {
+			spdlog::error("Bad addr chunk for {}", HexStr(scriptHash));
+			err = MDB_CORRUPTED;
+			break;
+		}
 
-	err = mdb_put(txn, dbi, &tx_key, &tx_val, NULL);
-	if (err != 0) {
-		spdlog::error("AddTXO write failed {}", mdb_strerror(err));
-		if (err == MDB_MAP_FULL) {
-			mdb_txn_abort(txn);
-			err = this->IncreaseMapSize();
+		//only the first chunk can start before from
+		if (first < from) {
+			auto it = std::lower_bound(refs.begin() + start, refs.end(), from);
+			refs.erase(refs.begin() + start, it);
 		}
-		return err;
+		err = mdb_cursor_get(cur, &key, &val, MDB_NEXT);
 	}
+	mdb_cursor_close(cur);
 
+	if (err != 0 && err != MDB_NOTFOUND) {
+		spdlog::error("Failed to read txos of {}: {}", HexStr(scriptHash), mdb_strerror(err));
+		return err;
+	}
 	return TXO_OK;
 }
 
-/// Pushes block tip with
-int TXODB::PushBlockTip(MDB_txn* tx, const CBlockHeader& h) {
-	return TXO_OK;
-}
+int TXODB::AddAddrRefs(MDB_txn* txn, const uint256& scriptHash, const TXORef* refs, size_t count) {
+	int err = 0;
+	MDB_cursor* cur;
+	if (err = mdb_cursor_open(txn, this->dbi_addr, &cur)) {
+		spdlog::error("Failed to open cursor: {}", mdb_strerror(err));
+		return err;
+	}
 
-void TXODB::PreLoadBlocks(std::string path) {
-	spdlog::info("Preload starting.. this will take some time.");
+	unsigned char key_buf[ADDR_CHUNK_KEY_MAX];
+	std::vector<TXORef> stored, merged;
+	std::vector<unsigned char> enc;
+	size_t x = 0;
+	while (x < count) {
+		//the chunk refs[x] goes in and where the chunk after it starts
+		MDB_val key, val;
+		bool haveChunk = false, haveNext = false;
+		TXORef first, next;
+		stored.clear();
+
+		err = this->SeekAddrChunk(cur, scriptHash, refs[x], key, val);
+		if (err == 0) {
+			haveChunk = true;
+			FixedCodec<TXORef>::Read((const unsigned char*)key.mv_data + this->addrKeyBytes, first);
+			if (!TXORefChunk::Decode(first, (const unsigned char*)val.mv_data, val.mv_size, stored)) {
+				spdlog::error("Bad addr chunk for {}", HexStr(scriptHash));
+				err = MDB_CORRUPTED;
+				break;
+			}
 
-	mdb_env_set_flags(this->env, MDB_NOSYNC, 1);
+			err = mdb_cursor_get(cur, &key, &val, MDB_NEXT);
+			if (err == 0 && this->IsAddrChunk(key, scriptHash)) {
+				haveNext = true;
+				FixedCodec<TXORef>::Read((const unsigned char*)key.mv_data + this->addrKeyBytes, next);
+			}
+		}
+		if (err != 0 && err != MDB_NOTFOUND) {
+			break;
+		}
+		err = 0;
 
-	std::vector<std::filesystem::path> blks;
-	std::mutex blks_pop_lock;
+		auto end = x;
+		while (end < count && (!haveNext || refs[end] < next)) {
+			end++;
+		}
 
-	std::atomic<uint32_t> nBlockFilesDone = 0;
-	std::atomic<uint64_t> rate_block_process = 0;
-	std::atomic<uint64_t> rate_tx_process = 0;
-	std::atomic<uint64_t> total_tx_process = 0;
-	std::atomic<uint64_t> total_block_process = 0;
-	std::atomic<std::chrono::time_point<std::chrono::system_clock>> rate_last_print = std::chrono::system_clock::now();
+		//refs that are stored already are dropped
+		merged.clear();
+		std::set_union(stored.begin(), stored.end(), refs + x, refs + end, std::back_inserter(merged));
+		x = end;
 
-	uint32_t nBlockFiles = 0;
-	for (auto& entry : std::filesystem::directory_iterator(path)) {
-		if (entry.path().filename().string().find("blk") == 0) {
-			blks.push_back(entry.path());
-			nBlockFiles++;
+		//the chunk is written again under its new first ref
+		if (haveChunk) {
+			MDB_val old_key = this->AddrChunkKey(key_buf, scriptHash, first);
+			if (err = mdb_del(txn, this->dbi_addr, &old_key, nullptr)) {
+				break;
+			}
 		}
+		for (size_t c = 0; c < merged.size(); c += ADDR_CHUNK_MAX) {
+			auto n = std::min(ADDR_CHUNK_MAX, merged.size() - c);
+			TXORefChunk::Encode(merged.data() + c, n, enc);
+
+			MDB_val chunk_key = this->AddrChunkKey(key_buf, scriptHash, merged[c]);
+			MDB_val chunk_val = {
+				enc.size(),
+				enc.data()
+			};
+			if (err = mdb_put(txn, this->dbi_addr, &chunk_key, &chunk_val, 0)) {
+				break;
+			}
+		}
+		if (err != 0) {
+			break;
+		}
+	}
+	mdb_cursor_close(cur);
+
+	if (err != 0) {
+		spdlog::error("Addr txns write failed {}", mdb_strerror(err));
+		return err;
+	}
+	return TXO_OK;
+}
+
+int TXODB::IncreaseMapSize() {
+	std::lock_guard<std::mutex> x(this->resize_lock);
+	int err = 0;
+	struct MDB_envinfo current_info;
+	if (err = mdb_env_info(this->env, &current_info)) {
+		spdlog::error("Failed to get env info for resize: {}", mdb_strerror(err));
+		return err;
 	}
 
-	auto pos_txo = blks.begin();
-	auto pos_txo_end = blks.end();
-	std::vector<std::thread*> preload_threads(std::min(4u, std::thread::hardware_concurrency()));
-	spdlog::info("Using {} threads for preloading..", preload_threads.size());
+	size_t new_size = (current_info.me_mapsize - (current_info.me_mapsize % MAPSIZE_BASE_UNIT)) + MAPSIZE_BASE_UNIT;
+	spdlog::info("Setting mapsize to {}", new_size);
+	if (err = mdb_env_set_mapsize(this->env, new_size)) {
+		spdlog::error("Failed to resize map: {}", mdb_strerror(err));
+		return err;
+	}
+	return TXO_RESIZED;
+}
 
-	int mode = 0;
-	auto preload_func = [&mode, &pos_txo, &pos_txo_end, &blks_pop_lock, &nBlockFilesDone, nBlockFiles, this, &rate_tx_process, &rate_last_print, &total_tx_process, &rate_block_process, &total_block_process] {
-		std::filesystem::path blk_path;
-		CBlock blk;
-		while (1) {
-			{
-				std::lock_guard<std::mutex> pos_lock(blks_pop_lock);
-				//mdb_env_sync(this->env, 0);
+int TXODB::StartTXOTxn(MDB_txn** txn, const char* dbn, MDB_dbi& dbi) {
+	int err = 0;
+	if (err = mdb_txn_begin(this->env, nullptr, 0, txn)) {
+		spdlog::error("Failed to start txo: {}", mdb_strerror(err));
+		return err;
+	}
 
-				if (pos_txo == pos_txo_end) {
-					break; // end of block list
-				}
-				blk_path = *pos_txo;
-				nBlockFilesDone++;
+	if (err = mdb_dbi_open(*txn, dbn, MDB_CREATE, &dbi)) {
+		spdlog::error("Failed to open dbi {}: {}", dbn, mdb_strerror(err));
+		err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
+		return err;
+	}
 
-				std::advance(pos_txo, 1);
-			}
+	return TXO_OK;
+}
 
-			//read block file
-			auto fn = blk_path.filename().string();
-			spdlog::info("Loading block file {} ({}/{} {:.2f}%)", fn, nBlockFilesDone, nBlockFiles, 100.0 * ((float)nBlockFilesDone / (float)nBlockFiles));
-
-			auto bf_p = fopen(blk_path.string().c_str(), "rb");
-			CBufferedFile bf(bf_p, PRELOAD_BUFFER_SIZE, 4, SER_DISK, PROTOCOL_VERSION); //allow rewinding of net_magic
-
-			char net_magic[4];
-			uint32_t len = 0, offset = 0;
-
-			while (1) {
-				memset(net_magic, 0, 4);
-				len = 0;
-				offset = 0;
-				blk.SetNull();
-
-				if (!bf.eof()) {
-					try {
-						bf >> net_magic;
-						bf >> len;
-
-						if (len == 0) {
-							break;
-						}
-
-						if (!(net_magic[0] == '\xfa' && net_magic[1] == '\xbf' && net_magic[2] == '\xb5' && net_magic[3] == '\xda')) {
-							spdlog::warn("Invalid blockchain {}", len);
-							continue;
-						}
-
-						if (len > 0) {
-							//peek and see if we have a missing block
-							bf >> net_magic;
-							bf.SetPos(bf.GetPos() - 4);
-							if (net_magic[0] == '\xfa' && net_magic[1] == '\xbf' && net_magic[2] == '\xb5' && net_magic[3] == '\xda') {
-								//we haved an empty block go skip to next read
-								continue;
-							}
-
-							bf >> blk;
-
-							//start a tx for this block
-							int err = 0;
-							MDB_txn* txn;
-							MDB_dbi dbi;
-							MDB_dbi dbi_addr;
-							MDB_dbi dbi_blk;
-
-						try_block_again:
-							if (err = mdb_txn_begin(this->env, nullptr, 0, &txn)) {
-								spdlog::error("Failed to start txo: {}", mdb_strerror(err));
-								return err;
-							}
-
-							if (err = mdb_dbi_open(txn, DBI_TXO, MDB_CREATE | MDB_DUPSORT, &dbi)) {
-								spdlog::error("Failed to open dbi {}: {}", DBI_TXO, mdb_strerror(err));
-								err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
-								return err;
-							}
-
-							if (err = mdb_dbi_open(txn, DBI_ADDR, MDB_CREATE | MDB_DUPSORT, &dbi_addr)) {
-								spdlog::error("Failed to open dbi {}: {}", DBI_ADDR, mdb_strerror(err));
-								err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
-								return err;
-							}
-							if (err = mdb_dbi_open(txn, DBI_BLK, MDB_CREATE, &dbi_blk)) {
-								spdlog::error("Failed to open dbi {}: {}", DBI_BLK, mdb_strerror(err));
-								err == MDB_MAP_FULL && (err = this->IncreaseMapSize());
-								return err;
-							}
-
-							// Add dupsort for txo
-							if (err = mdb_set_dupsort(txn, dbi, [](const MDB_val* a, const MDB_val* b) -> int {
-								//first member of a TXO is its N index, use this to sort the outputs
-								uint32_t* an = (uint32_t*)a->mv_data;
-								uint32_t* bn = (uint32_t*)b->mv_data;
-								return *an - *bn;
-								})) {
-								spdlog::error("Failed to set cmpfunc for dbi {}: {}", DBI_TXO, mdb_strerror(err));
-								return err;
-							}
-
-							CDataStream ds(SER_DISK, PROTOCOL_VERSION);
-							uint256 blkHash = blk.GetHash();
-
-							//Store the block header
-							MDB_val blk_key = {
-									blkHash.size(),
-									blkHash.begin()
-							};
-
-							ds.clear();
-							ds.reserve(80);
-							ds << blk.GetBlockHeader();
-
-							MDB_val blk_val = {
-								ds.size(),
-								ds.data()
-							};
-
-							err = mdb_put(txn, dbi_blk, &blk_key, &blk_val, MDB_NODUPDATA);
-							if (err != 0) {
-								spdlog::error("AddBLK write failed {}", mdb_strerror(err));
-								if (err == MDB_MAP_FULL) {
-									mdb_txn_abort(txn);
-									if ((err = this->IncreaseMapSize()) != TXO_RESIZED) {
-										spdlog::error("Failed to increase map size, thread exiting..");
-										return err;
-									}
-									goto try_block_again;
-								}
-								return err;
-							}
-
-							for (auto tx : blk.vtx) {
-								uint256 txHash = tx->GetHash();
-
-								MDB_cursor* curtx;
-								mdb_cursor_open(txn, dbi, &curtx);
-
-								//create a reference to this transaction as an output
-								COutPoint out_tx;
-								out_tx.hash = txHash;
-
-								MDB_val tx_key = {
-									txHash.size(),
-									txHash.begin()
-								};
-
-								//process inputs or outputs
-								if (mode == 1) {
-									int txip = 0;
-									for (auto ntxi : tx->vin) {
-										//check is coinbase txin
-										if (!ntxi.prevout.IsNull()) {
-											COutPoint thisTxi;
-											thisTxi.hash = txHash;
-											thisTxi.n = txip;
-											if (this->InternalSpendTXO(ntxi.prevout, thisTxi) == TXO_RESIZED) {
-												this->InternalSpendTXO(ntxi.prevout, thisTxi);
-											}
-										}
-
-										txip++;
-									}
-								}
-								else {
-									int txop = 0;
-									for (auto ntxo : tx->vout) {
-										uint256 sh = SHash(ntxo.scriptPubKey.begin(), ntxo.scriptPubKey.end());
-
-										TXO t(sh, txHash, txop++, ntxo.nValue, 0);
-										out_tx.n = t.n; //output n
-
-										int err = 0;
-										ds.clear();
-										ds.reserve(36);
-										ds << out_tx;
-
-										//scriptHash(address) key
-										MDB_val addr_key{
-											sh.size(),
-											sh.begin()
-										};
-										MDB_val addr_val = {
-											ds.size(),
-											ds.data()
-										};
-
-										err = mdb_put(txn, dbi_addr, &addr_key, &addr_val, MDB_NODUPDATA);
-										if (err != 0) {
-											if (err == MDB_MAP_FULL) {
-												mdb_txn_abort(txn);
-												if ((err = this->IncreaseMapSize()) != TXO_RESIZED) {
-													spdlog::error("Failed to increase map size, thread exiting..");
-													return err;
-												}
-												goto try_block_again;
-											}
-											else if (err == MDB_KEYEXIST) {
-												spdlog::warn("Duplicate output for addr {} ({}:{})", sh.GetHex(), out_tx.hash.GetHex(), out_tx.n);
-												continue;
-											}
-
-											spdlog::error("Addr txns write failed {}", mdb_strerror(err));
-											return err;
-										}
-										else {
-											spdlog::debug("Found new scriptHash: {}", HexStr(sh));
-											spdlog::debug("=val: {}", HexStr((char*)addr_val.mv_data, (char*)addr_val.mv_data + addr_val.mv_size));
-										}
-
-										//clear the datastream and store the txo
-										ds.clear();
-										ds.reserve(TXO::ApproxSize);
-										ds << t;
-
-										MDB_val tx_val = {
-											ds.size(),
-											ds.data()
-										};
-
-										err = mdb_cursor_put(curtx, &tx_key, &tx_val, MDB_APPENDDUP);
-										if (err != 0) {
-											spdlog::error("AddTXO write failed {}", mdb_strerror(err));
-											if (err == MDB_MAP_FULL) {
-												mdb_txn_abort(txn);
-												if ((err = this->IncreaseMapSize()) != TXO_RESIZED) {
-													spdlog::error("Failed to increase map size, thread exiting..");
-													return err;
-												}
-												goto try_block_again;
-											}
-											return err;
-										}
-									}
-								}
-
-								mdb_cursor_close(curtx);
-								rate_tx_process++;
-								total_tx_process++;
-							}
-
-							mdb_txn_commit(txn);
-							rate_block_process++;
-							total_block_process++;
-
-							auto last_print = rate_last_print.load();
-							std::chrono::duration<double> nt = std::chrono::system_clock::now() - last_print; //race
-							if (nt.count() >= 5) {
-								auto last_interval = rate_last_print.exchange(std::chrono::system_clock::now());
-								//check again
-								if ((std::chrono::system_clock::now() - last_interval).count() >= 5) {
-									auto ntx = rate_tx_process.exchange(0);
-									auto nblk = rate_block_process.exchange(0);
-									auto ttx = total_tx_process.load();
-									auto tblk = total_block_process.load();
-									spdlog::info("{:n} blk/s, {:n} txo/s, {:n} txn, {:n} blk", (uint64_t)(nblk / nt.count()), (uint64_t)(ntx / nt.count()), ttx, tblk);
-								}
-							}
-						}
-						else {
-							spdlog::warn("Invalid len {}", len);
-						}
-					}
-					catch (std::ios_base::failure ex) {
-						spdlog::error("{}", ex.what());
-					}
-				}
-				else {
-					break;
-				}
-			}
 
-			bf.fclose();
-			mdb_env_sync(this->env, 1);//make sure to force sync here!
-		}
-	};
+int TXODB::InternalSpendTXO(MDB_cursor* cur, const COutPoint& prevout, const COutPoint& spendingTx) {
+	int err = 0;
 
-	//load all outputs first
-	std::transform(preload_threads.begin(), preload_threads.end(), preload_threads.begin(), [&](std::thread*) {
-		return new std::thread(preload_func);
-		});
-	for (auto t : preload_threads) {
-		t->join();
-	}
+	unsigned char key_buf[FixedCodec<COutPoint>::Size];
+	unsigned char val_buf[FixedCodec<COutPoint>::Size];
+	FixedCodec<COutPoint>::Write(key_buf, prevout);
+	FixedCodec<COutPoint>::Write(val_buf, spendingTx);
 
-	spdlog::info("All outputs are loaded!");
+	MDB_val key = {
+		sizeof(key_buf),
+		key_buf
+	};
+	MDB_val val = {
+		sizeof(val_buf),
+		val_buf
+	};
 
-	//spend 
-	//mdb_env_sync(this->env, 1);
-	nBlockFilesDone = 0;
-	mode = 1;
-	pos_txo = blks.begin();
-	std::transform(preload_threads.begin(), preload_threads.end(), preload_threads.begin(), [&](std::thread*) {
-		return new std::thread(preload_func);
-		});
-	for (auto t : preload_threads) {
-		t->join();
+	if (err = mdb_cursor_put(cur, &key, &val, 0)) {
+		spdlog::error("InternalSpendTXO write failed {}", mdb_strerror(err));
+		return err;
 	}
+	return TXO_OK;
+}
 
-	spdlog::info("Preload finished!");
-}
\ No newline at end of file
+/// Pushes block tip with
+int TXODB::PushBlockTip(MDB_txn* tx, const CBlockHeader& h) {
+	return TXO_OK;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2019 v0l
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <electrumz/bitcoin/arena.h>
+
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+static thread_local Arena* g_current_arena = nullptr;
+
+Arena::Arena(size_t chunkSize) : m_chunkSize(chunkSize) {}
+
+Arena::~Arena()
+{
+    for (const auto& chunk : m_chunks) {
+        free(chunk.first);
+    }
+}
+
+void* Arena::AllocateSlow(size_t size, size_t align)
+{
+    size_t chunkSize = std::max(m_chunkSize, size + align);
+    char* chunk = static_cast<char*>(malloc(chunkSize));
+    if (chunk == nullptr) {
+        throw std::bad_alloc();
+    }
+    m_chunks.emplace_back(chunk, chunkSize);
+    m_cur = chunk;
+    m_end = chunk + chunkSize;
+    return Allocate(size, align);
+}
+
+void Arena::Reset()
+{
+    if (m_chunks.size() > 1) {
+        // one chunk the size of all of them, the next round of the same size needs no malloc
+        size_t total = 0;
+        for (const auto& chunk : m_chunks) {
+            total += chunk.second;
+            free(chunk.first);
+        }
+        m_chunks.clear();
+        m_chunkSize = std::max(m_chunkSize, total);
+        m_cur = m_end = nullptr;
+    } else if (!m_chunks.empty()) {
+        m_cur = m_chunks[0].first;
+    }
+    m_used = 0;
+}
+
+Arena* Arena::Current()
+{
+    return g_current_arena;
+}
+
+Arena::Scope::Scope(Arena& arena) : m_prev(g_current_arena)
+{
+    g_current_arena = &arena;
+}
+
+Arena::Scope::~Scope()
+{
+    g_current_arena = m_prev;
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2019 v0l
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <electrumz/bitcoin/blockview.h>
+#include <electrumz/bitcoin/hash.h>
+
+uint256 CTransactionView::GetHash() const
+{
+    uint256 ret;
+    CHash256()
+        .Write(m_begin, m_versionEnd - m_begin)
+        .Write(m_vin, m_voutEnd - m_vin)
+        .Write(m_lockTime, m_end - m_lockTime)
+        .Finalize(ret.begin());
+    return ret;
+}
+
+bool CBlockView::Parse(const unsigned char* data, size_t size)
+{
+    try {
+        SpanReader r(SER_DISK, PROTOCOL_VERSION, data, size);
+        r >> header;
+        m_data = data;
+        m_ntx = ReadCompactSize(r);
+        m_vtx = r.data();
+
+        CTransactionView tx;
+        for (size_t i = 0; i < m_ntx; i++) {
+            tx.Read(r);
+        }
+        return true;
+    } catch (const std::ios_base::failure&) {
+        m_ntx = 0;
+        return false;
+    }
+}
+
+uint256 CBlockView::GetHash() const
+{
+    return Hash(m_data, m_data + 80);
+}
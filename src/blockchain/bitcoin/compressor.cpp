@@ -0,0 +1,153 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <electrumz/bitcoin/compressor.h>
+
+#include <mbedtls/bignum.h>
+
+#include <string.h>
+
+/** secp256k1 field prime and (p + 1) / 4, p = 3 mod 4 so y = (x^3 + 7)^((p + 1) / 4) */
+static const char* SECP256K1_P = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F";
+static const char* SECP256K1_P_SQRT_EXP = "3FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFBFFFFF0C";
+
+/**
+ * Recovers the uncompressed form of a compressed public key (CPubKey::Decompress)
+ */
+static bool DecompressPubKey(const unsigned char in[33], unsigned char out[65])
+{
+    if (in[0] != 0x02 && in[0] != 0x03) {
+        return false;
+    }
+
+    mbedtls_mpi p, e, x, rhs, y, check;
+    mbedtls_mpi_init(&p);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&rhs);
+    mbedtls_mpi_init(&y);
+    mbedtls_mpi_init(&check);
+
+    bool ok = mbedtls_mpi_read_string(&p, 16, SECP256K1_P) == 0
+        && mbedtls_mpi_read_string(&e, 16, SECP256K1_P_SQRT_EXP) == 0
+        && mbedtls_mpi_read_binary(&x, in + 1, 32) == 0
+        && mbedtls_mpi_cmp_mpi(&x, &p) < 0
+        // rhs = x^3 + 7 mod p
+        && mbedtls_mpi_mul_mpi(&rhs, &x, &x) == 0
+        && mbedtls_mpi_mod_mpi(&rhs, &rhs, &p) == 0
+        && mbedtls_mpi_mul_mpi(&rhs, &rhs, &x) == 0
+        && mbedtls_mpi_add_int(&rhs, &rhs, 7) == 0
+        && mbedtls_mpi_mod_mpi(&rhs, &rhs, &p) == 0
+        && mbedtls_mpi_exp_mod(&y, &rhs, &e, &p, nullptr) == 0
+        // not every x is on the curve
+        && mbedtls_mpi_mul_mpi(&check, &y, &y) == 0
+        && mbedtls_mpi_mod_mpi(&check, &check, &p) == 0
+        && mbedtls_mpi_cmp_mpi(&check, &rhs) == 0;
+
+    if (ok && mbedtls_mpi_get_bit(&y, 0) != (in[0] & 1)) {
+        ok = mbedtls_mpi_sub_mpi(&y, &p, &y) == 0;
+    }
+    if (ok) {
+        out[0] = 0x04;
+        memcpy(out + 1, in + 1, 32);
+        ok = mbedtls_mpi_write_binary(&y, out + 33, 32) == 0;
+    }
+
+    mbedtls_mpi_free(&p);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&rhs);
+    mbedtls_mpi_free(&y);
+    mbedtls_mpi_free(&check);
+    return ok;
+}
+
+unsigned int CScriptCompressor::GetSpecialSize(unsigned int nSize) const
+{
+    if (nSize == 0 || nSize == 1)
+        return 20;
+    if (nSize == 2 || nSize == 3 || nSize == 4 || nSize == 5)
+        return 32;
+    return 0;
+}
+
+bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigned char> &in)
+{
+    switch(nSize) {
+    case 0x00:
+        script.resize(25);
+        script[0] = OP_DUP;
+        script[1] = OP_HASH160;
+        script[2] = 20;
+        memcpy(&script[3], in.data(), 20);
+        script[23] = OP_EQUALVERIFY;
+        script[24] = OP_CHECKSIG;
+        return true;
+    case 0x01:
+        script.resize(23);
+        script[0] = OP_HASH160;
+        script[1] = 20;
+        memcpy(&script[2], in.data(), 20);
+        script[22] = OP_EQUAL;
+        return true;
+    case 0x02:
+    case 0x03:
+        script.resize(35);
+        script[0] = 33;
+        script[1] = nSize;
+        memcpy(&script[2], in.data(), 32);
+        script[34] = OP_CHECKSIG;
+        return true;
+    case 0x04:
+    case 0x05:
+        unsigned char vch[33] = {};
+        vch[0] = nSize - 2;
+        memcpy(&vch[1], in.data(), 32);
+        unsigned char pubkey[65];
+        if (!DecompressPubKey(vch, pubkey))
+            return false;
+        script.resize(67);
+        script[0] = 65;
+        memcpy(&script[1], pubkey, 65);
+        script[66] = OP_CHECKSIG;
+        return true;
+    }
+    return false;
+}
+
+// Amount compression:
+// * If the amount is 0, output 0
+// * first, divide the amount (in base units) by the largest power of 10 possible; call the exponent e (e is max 9)
+// * if e<9, the last digit of the resulting number cannot be 0; store it as d, and drop it (divide by 10)
+//   * call the result n
+//   * output 1 + 10*(9*n + d - 1) + e
+// * if e==9, we only know the resulting number is not zero, so output 1 + 10*(n - 1) + 9
+// (this is decodable, as d is in [1-9] and e is in [0-9])
+
+uint64_t DecompressAmount(uint64_t x)
+{
+    // x = 0  OR  x = 1+10*(9*n + d - 1) + e  OR  x = 1+10*(n - 1) + 9
+    if (x == 0)
+        return 0;
+    x--;
+    // x = 10*(9*n + d - 1) + e
+    int e = x % 10;
+    x /= 10;
+    uint64_t n = 0;
+    if (e < 9) {
+        // x = 9*n + d - 1
+        int d = (x % 9) + 1;
+        x /= 9;
+        // x = n
+        n = x*10 + d;
+    } else {
+        n = x+1;
+    }
+    while (e) {
+        n *= 10;
+        e--;
+    }
+    return n;
+}
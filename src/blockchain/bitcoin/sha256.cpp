@@ -0,0 +1,445 @@
+// Copyright (c) 2014-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <electrumz/bitcoin/sha256.h>
+#include <electrumz/bitcoin/crypto_common.h>
+
+#include <mbedtls/sha256.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(USE_ASM)
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void Transform_2way(uint32_t* s, const unsigned char* const* chunks);
+}
+#endif
+
+#if defined(ENABLE_SSE41)
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* const* chunks);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks);
+}
+#endif
+
+#if defined(ENABLE_AVX512)
+namespace sha256_avx512
+{
+void Transform_16way(uint32_t* s, const unsigned char* const* chunks);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal SHA-256 implementation.
+namespace sha256
+{
+/** Initialize SHA-256 state. */
+void inline Initialize(uint32_t* s)
+{
+    s[0] = 0x6a09e667ul;
+    s[1] = 0xbb67ae85ul;
+    s[2] = 0x3c6ef372ul;
+    s[3] = 0xa54ff53aul;
+    s[4] = 0x510e527ful;
+    s[5] = 0x9b05688cul;
+    s[6] = 0x1f83d9abul;
+    s[7] = 0x5be0cd19ul;
+}
+
+/** Perform a number of SHA-256 transformations, using the mbedtls block function. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    memcpy(ctx.state, s, sizeof(ctx.state));
+    while (blocks--) {
+        mbedtls_internal_sha256_process(&ctx, chunk);
+        chunk += 64;
+    }
+    memcpy(s, ctx.state, sizeof(ctx.state));
+    mbedtls_sha256_free(&ctx);
+}
+
+} // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+
+TransformType Transform = sha256::Transform;
+
+/** One block for each of N independent states, see SHA256Batch. */
+typedef void (*TransformLanesType)(uint32_t*, const unsigned char* const*);
+
+const size_t MAX_LANES = 16;
+
+TransformLanesType TransformLanes = nullptr;
+size_t Lanes = 1;
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS saves the given XCR0 state components (AVX, AVX-512 registers). */
+bool XSaveEnabled(uint32_t mask)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & mask) == mask;
+}
+#endif
+} // namespace
+
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "mbedtls";
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    bool have_sse4 = false;
+    bool have_osxsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool have_avx512 = false;
+    bool have_shani = false;
+
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        have_osxsave = (ecx >> 27) & 1;
+        have_avx = (ecx >> 28) & 1;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        have_avx2 = (ebx >> 5) & 1;
+        have_avx512 = (ebx >> 16) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+
+    // the OS has to save the wider registers too
+    bool enabled_avx = have_osxsave && have_avx && XSaveEnabled(0x6);
+    bool enabled_avx512 = enabled_avx && XSaveEnabled(0xe6);
+
+    // not every kernel is built on every target
+    (void)have_sse4;
+    (void)have_shani;
+    (void)have_avx2;
+    (void)have_avx512;
+    (void)enabled_avx512;
+
+#if defined(ENABLE_SHANI)
+    if (have_shani && have_sse4) {
+        Transform = sha256_shani::Transform;
+        TransformLanes = sha256_shani::Transform_2way;
+        Lanes = 2;
+        ret = "shani(1way,2way)";
+
+        // two interleaved SHA-NI streams keep up with 16 AVX-512 lanes and beat 4 or 8
+        have_sse4 = false;
+        have_avx2 = false;
+        have_avx512 = false;
+    }
+#endif
+
+    // wider lanes first, a lane kernel is only used for SHA256Batch and SHA256D64
+#if defined(ENABLE_AVX512)
+    if (TransformLanes == nullptr && have_avx512 && enabled_avx512) {
+        TransformLanes = sha256_avx512::Transform_16way;
+        Lanes = 16;
+        ret += ",avx512(16way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (TransformLanes == nullptr && have_avx2 && enabled_avx) {
+        TransformLanes = sha256_avx2::Transform_8way;
+        Lanes = 8;
+        ret += ",avx2(8way)";
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (TransformLanes == nullptr && have_sse4) {
+        TransformLanes = sha256_sse41::Transform_4way;
+        Lanes = 4;
+        ret += ",sse4.1(4way)";
+    }
+#endif
+#endif
+    return ret;
+}
+
+////// SHA-256
+
+CSHA256::CSHA256() : bytes(0)
+{
+    sha256::Initialize(s);
+}
+
+CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    size_t bufsize = bytes % 64;
+    if (bufsize && bufsize + len >= 64) {
+        // Fill the buffer, and process it.
+        memcpy(buf + bufsize, data, 64 - bufsize);
+        bytes += 64 - bufsize;
+        data += 64 - bufsize;
+        Transform(s, buf, 1);
+        bufsize = 0;
+    }
+    if (end - data >= 64) {
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
+    }
+    if (end > data) {
+        // Fill the buffer with what remains.
+        memcpy(buf + bufsize, data, end - data);
+        bytes += end - data;
+    }
+    return *this;
+}
+
+void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    static const unsigned char pad[64] = {0x80};
+    unsigned char sizedesc[8];
+    WriteBE64(sizedesc, bytes << 3);
+    Write(pad, 1 + ((119 - (bytes % 64)) % 64));
+    Write(sizedesc, 8);
+    WriteBE32(hash, s[0]);
+    WriteBE32(hash + 4, s[1]);
+    WriteBE32(hash + 8, s[2]);
+    WriteBE32(hash + 12, s[3]);
+    WriteBE32(hash + 16, s[4]);
+    WriteBE32(hash + 20, s[5]);
+    WriteBE32(hash + 24, s[6]);
+    WriteBE32(hash + 28, s[7]);
+}
+
+CSHA256& CSHA256::Reset()
+{
+    bytes = 0;
+    sha256::Initialize(s);
+    return *this;
+}
+
+size_t CSHA256::SaveMidstate(unsigned char out[MIDSTATE_MAX_SIZE]) const
+{
+    WriteLE64(out, bytes);
+    for (int i = 0; i < 8; i++) {
+        WriteLE32(out + 8 + 4 * i, s[i]);
+    }
+    memcpy(out + 40, buf, bytes % 64);
+    return 40 + bytes % 64;
+}
+
+bool CSHA256::LoadMidstate(const unsigned char* in, size_t len)
+{
+    if (len < 40 || len != 40 + ReadLE64(in) % 64) {
+        return false;
+    }
+    bytes = ReadLE64(in);
+    for (int i = 0; i < 8; i++) {
+        s[i] = ReadLE32(in + 8 + 4 * i);
+    }
+    memcpy(buf, in + 40, bytes % 64);
+    return true;
+}
+
+////// SHA-256D64
+
+namespace
+{
+/** Padding of a 64 byte message, the second block of the first hash. */
+const unsigned char PADDING_64[64] = {
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+};
+
+/** Padding of a 32 byte message, the first 32 bytes are replaced with the first hash. */
+const unsigned char PADDING_32[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+};
+
+/** Double SHA-256 of one 64 byte input, the padding blocks are fixed so no CSHA256 is needed. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char second[64];
+    sha256::Initialize(s);
+    Transform(s, in, 1);
+    Transform(s, PADDING_64, 1);
+
+    memcpy(second, PADDING_32, 64);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(second + 4 * i, s[i]);
+    }
+    sha256::Initialize(s);
+    Transform(s, second, 1);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(out + 4 * i, s[i]);
+    }
+}
+
+/** TransformD64 for one 64 byte input in every lane. */
+void TransformD64Lanes(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[MAX_LANES * 8];
+    unsigned char second[MAX_LANES][64];
+    const unsigned char* chunks[MAX_LANES];
+
+    for (size_t l = 0; l < Lanes; l++) {
+        sha256::Initialize(s + 8 * l);
+        chunks[l] = in + 64 * l;
+    }
+    TransformLanes(s, chunks);
+    for (size_t l = 0; l < Lanes; l++) {
+        chunks[l] = PADDING_64;
+    }
+    TransformLanes(s, chunks);
+
+    for (size_t l = 0; l < Lanes; l++) {
+        memcpy(second[l], PADDING_32, 64);
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(second[l] + 4 * i, s[8 * l + i]);
+        }
+        sha256::Initialize(s + 8 * l);
+        chunks[l] = second[l];
+    }
+    TransformLanes(s, chunks);
+    for (size_t l = 0; l < Lanes; l++) {
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(out + 32 * l + 4 * i, s[8 * l + i]);
+        }
+    }
+}
+} // namespace
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformLanes != nullptr) {
+        while (blocks >= Lanes) {
+            TransformD64Lanes(out, in);
+            out += 32 * Lanes;
+            in += 64 * Lanes;
+            blocks -= Lanes;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
+
+////// SHA-256 batch
+
+void SHA256Batch(unsigned char* out, const unsigned char* const* in, const size_t* len, size_t n)
+{
+    if (TransformLanes == nullptr || n < 2) {
+        for (size_t i = 0; i < n; i++) {
+            CSHA256().Write(in[i], len[i]).Finalize(out + 32 * i);
+        }
+        return;
+    }
+
+    /** A message being hashed in one lane, full blocks are read in place, the padded tail from tail. */
+    struct Lane {
+        size_t msg;
+        const unsigned char* data;
+        size_t blocks;
+        unsigned char tail[128];
+        size_t tailBlocks;
+        size_t tailPos;
+    };
+    static const unsigned char idle[64] = {};
+    static const size_t IDLE = (size_t)-1;
+
+    Lane lanes[MAX_LANES];
+    uint32_t s[MAX_LANES * 8];
+    const unsigned char* chunks[MAX_LANES];
+    size_t next = 0, active = 0;
+
+    auto load = [&](size_t l) {
+        Lane& ln = lanes[l];
+        if (next == n) {
+            ln.msg = IDLE;
+            return;
+        }
+        ln.msg = next++;
+        size_t size = len[ln.msg];
+        size_t rem = size % 64;
+        ln.data = in[ln.msg];
+        ln.blocks = size / 64;
+        ln.tailBlocks = rem < 56 ? 1 : 2;
+        ln.tailPos = 0;
+        memcpy(ln.tail, ln.data + 64 * ln.blocks, rem);
+        ln.tail[rem] = 0x80;
+        memset(ln.tail + rem + 1, 0, 64 * ln.tailBlocks - 8 - rem - 1);
+        WriteBE64(ln.tail + 64 * ln.tailBlocks - 8, (uint64_t)size << 3);
+        sha256::Initialize(s + 8 * l);
+        active++;
+    };
+    auto finish = [&](size_t l) {
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(out + 32 * lanes[l].msg + 4 * i, s[8 * l + i]);
+        }
+        active--;
+    };
+
+    for (size_t l = 0; l < Lanes; l++) {
+        load(l);
+    }
+    while (active > 0) {
+        // once the input is used up and most lanes are idle, the single stream transform is cheaper
+        if (next == n && active * 2 <= Lanes) {
+            for (size_t l = 0; l < Lanes; l++) {
+                Lane& ln = lanes[l];
+                if (ln.msg != IDLE) {
+                    Transform(s + 8 * l, ln.data, ln.blocks);
+                    Transform(s + 8 * l, ln.tail + 64 * ln.tailPos, ln.tailBlocks - ln.tailPos);
+                    finish(l);
+                }
+            }
+            break;
+        }
+
+        for (size_t l = 0; l < Lanes; l++) {
+            Lane& ln = lanes[l];
+            if (ln.msg == IDLE) {
+                chunks[l] = idle;
+            } else if (ln.blocks > 0) {
+                chunks[l] = ln.data;
+                ln.data += 64;
+                ln.blocks--;
+            } else {
+                chunks[l] = ln.tail + 64 * ln.tailPos++;
+            }
+        }
+        TransformLanes(s, chunks);
+        for (size_t l = 0; l < Lanes; l++) {
+            Lane& ln = lanes[l];
+            if (ln.msg != IDLE && ln.blocks == 0 && ln.tailPos == ln.tailBlocks) {
+                finish(l);
+                load(l);
+            }
+        }
+    }
+}
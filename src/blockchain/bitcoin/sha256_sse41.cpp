@@ -0,0 +1,127 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way SHA-256 block transform using SSE4.1, one independent message per lane.
+
+// This file is compiled with -msse4.1, see CMakeLists.txt
+
+#include <electrumz/bitcoin/crypto_common.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+namespace sha256_sse41 {
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul,
+    0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul,
+    0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul,
+    0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul,
+    0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul,
+    0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul,
+    0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul,
+    0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul,
+    0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul
+};
+
+__m128i inline Set1(uint32_t x) { return _mm_set1_epi32(x); }
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+template<int n> __m128i inline Ror(__m128i x) { return Or(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+__m128i inline Xor3(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor3(Ror<2>(x), Ror<13>(x), Ror<22>(x)); }
+__m128i inline Sigma1(__m128i x) { return Xor3(Ror<6>(x), Ror<11>(x), Ror<25>(x)); }
+__m128i inline sigma0(__m128i x) { return Xor3(Ror<7>(x), Ror<18>(x), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor3(Ror<17>(x), Ror<19>(x), ShR(x, 10)); }
+
+/** One round of SHA-256. */
+void inline __attribute__((always_inline)) Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Word i of the message schedule plus the round constant, w holds the last 16 words. */
+__m128i inline __attribute__((always_inline)) Schedule(__m128i* w, int i)
+{
+    if (i >= 16) {
+        w[i & 15] = Add(Add(w[i & 15], sigma1(w[(i - 2) & 15])), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+    }
+    return Add(w[i & 15], Set1(K[i]));
+}
+
+/** Big-endian word at offset off of every lane's block. */
+__m128i inline Read(const unsigned char* const* chunks, int off)
+{
+    return _mm_setr_epi32(
+        ReadBE32(chunks[0] + off), ReadBE32(chunks[1] + off), ReadBE32(chunks[2] + off), ReadBE32(chunks[3] + off));
+}
+
+void inline Write(uint32_t* s, int i, __m128i x)
+{
+    alignas(64) uint32_t out[4];
+    _mm_storeu_si128((__m128i*)out, x);
+    for (int l = 0; l < 4; l++) {
+        s[l * 8 + i] = out[l];
+    }
+}
+
+} // namespace
+
+/**
+ * Runs one block through 4 independent SHA-256 states.
+ * s holds 8 words of state per lane (lane l at s + 8 * l), chunks[l] is lane l's 64 byte block.
+ */
+void Transform_4way(uint32_t* s, const unsigned char* const* chunks)
+{
+    __m128i w[16];
+    __m128i st[8];
+    for (int i = 0; i < 8; i++) {
+        st[i] = _mm_setr_epi32(
+            s[0 * 8 + i], s[1 * 8 + i], s[2 * 8 + i], s[3 * 8 + i]);
+    }
+    for (int i = 0; i < 16; i++) {
+        w[i] = Read(chunks, i * 4);
+    }
+
+    __m128i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i += 8) {
+        Round(a, b, c, d, e, f, g, h, Schedule(w, i));
+        Round(h, a, b, c, d, e, f, g, Schedule(w, i + 1));
+        Round(g, h, a, b, c, d, e, f, Schedule(w, i + 2));
+        Round(f, g, h, a, b, c, d, e, Schedule(w, i + 3));
+        Round(e, f, g, h, a, b, c, d, Schedule(w, i + 4));
+        Round(d, e, f, g, h, a, b, c, Schedule(w, i + 5));
+        Round(c, d, e, f, g, h, a, b, Schedule(w, i + 6));
+        Round(b, c, d, e, f, g, h, a, Schedule(w, i + 7));
+    }
+
+    Write(s, 0, Add(a, st[0]));
+    Write(s, 1, Add(b, st[1]));
+    Write(s, 2, Add(c, st[2]));
+    Write(s, 3, Add(d, st[3]));
+    Write(s, 4, Add(e, st[4]));
+    Write(s, 5, Add(f, st[5]));
+    Write(s, 6, Add(g, st[6]));
+    Write(s, 7, Add(h, st[7]));
+}
+}
@@ -7,6 +7,7 @@
 
 #include <electrumz/bitcoin/hash.h>
 #include <electrumz/bitcoin/serialize.h>
+#include <electrumz/bitcoin/streams.h>
 #include <electrumz/bitcoin/util_strencodings.h>
 
 std::string COutPoint::ToString() const
@@ -76,9 +77,67 @@ uint256 CTransaction::ComputeWitnessHash() const
 }
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{} {}
+CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()} {}
+
+struct CTransaction::Hashed {
+    CMutableTransaction tx;
+    uint256 hash;
+};
+
+CTransaction::CTransaction(Hashed&& tx) : vin(std::move(tx.tx.vin)), vout(std::move(tx.tx.vout)), nVersion(tx.tx.nVersion), nLockTime(tx.tx.nLockTime), hash{tx.hash} {}
+CTransaction::CTransaction(deserialize_type, SpanReader& s) : CTransaction(UnserializeHashed(s)) {}
+
+/** UnserializeTransaction, but remembers where each part is in the buffer so the
+ *  txid can be hashed from the bytes directly, skipping the marker, flag and witnesses. */
+CTransaction::Hashed CTransaction::UnserializeHashed(SpanReader& s)
+{
+    Hashed ret;
+    CMutableTransaction& tx = ret.tx;
+    const bool fAllowWitness = !(s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS);
+
+    const unsigned char* begin = s.data();
+    s >> tx.nVersion;
+    const unsigned char* versionEnd = s.data();
+    const unsigned char* vinBegin = versionEnd;
+    unsigned char flags = 0;
+    /* Try to read the vin. In case the dummy is there, this will be read as an empty vector. */
+    s >> tx.vin;
+    if (tx.vin.size() == 0 && fAllowWitness) {
+        /* We read a dummy or an empty vin. */
+        s >> flags;
+        if (flags != 0) {
+            vinBegin = s.data();
+            s >> tx.vin;
+            s >> tx.vout;
+        }
+    } else {
+        /* We read a non-empty vin. Assume a normal vout follows. */
+        s >> tx.vout;
+    }
+    const unsigned char* voutEnd = s.data();
+    if ((flags & 1) && fAllowWitness) {
+        /* The witness flag is present, and we support witnesses. */
+        flags ^= 1;
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            s >> tx.vin[i].scriptWitness.stack;
+        }
+    }
+    if (flags) {
+        /* Unknown flag in the serialization */
+        throw std::ios_base::failure("Unknown transaction optional data");
+    }
+    const unsigned char* lockTimeBegin = s.data();
+    s >> tx.nLockTime;
+
+    CHash256()
+        .Write(begin, versionEnd - begin)
+        .Write(vinBegin, voutEnd - vinBegin)
+        .Write(lockTimeBegin, s.data() - lockTimeBegin)
+        .Finalize(ret.hash.begin());
+    return ret;
+}
 
 CAmount CTransaction::GetValueOut() const
 {
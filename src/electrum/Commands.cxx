@@ -51,6 +51,10 @@ void ::to_json(nlohmann::json& j, const TxOut& r) {
 }
 
 void ::to_json(nlohmann::json& j, const ScriptStatus& r) {
+	if (r.Empty()) {
+		j = nullptr;
+		return;
+	}
 	auto h = r.GetStatusHash();
 	j = HexStr(h.begin(), h.end());
 }
@@ -81,7 +85,7 @@ void ::to_json(nlohmann::json& j, const BCRelayfeeResponse& r) {
 void ::to_json(nlohmann::json& j, const SHGetBalanceResponse& r) {
 	j = nlohmann::json{
 		{ "confirmed", r.confirmed },
-		{ "unconfiemd", r.unconfirmed }
+		{ "unconfirmed", r.unconfirmed }
 	};
 }
 
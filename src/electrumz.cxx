@@ -5,11 +5,12 @@
 #include <spdlog/spdlog.h>
 #include <electrumz/NetWorker.h>
 #include <electrumz/TXODB.h>
+#include <electrumz/bitcoin/sha256.h>
 
 using namespace electrumz;
 using namespace electrumz::blockchain;
 
-struct arg_lit *help, *version;
+struct arg_lit *help, *version, *bulk;
 struct arg_str *preload;
 struct arg_end *end;
 
@@ -18,6 +19,7 @@ int main(int argc, char* argv[]) {
         help    = arg_lit0("h", "help", "Display this help and exit"),
         version = arg_lit0(nullptr, "version", "Display version info and exit"),
         preload = arg_str0(nullptr, "preload", "<datadir>", "Preload DB from Bitcoin Core blocks dir"),
+        bulk    = arg_lit0(nullptr, "bulk", "Preload an empty DB with an external sort (faster)"),
         end     = arg_end(20),
     };
 
@@ -34,8 +36,9 @@ int main(int argc, char* argv[]) {
 	spdlog::set_level(spdlog::level::level_enum::trace);
 #endif
 	spdlog::info("Starting electrumz..");
+	spdlog::info("Using SHA256 implementation: {}", SHA256AutoDetect());
 	auto cfg = new util::Config("config.json");
-	auto db = new TXODB("db");
+	auto db = new TXODB("db", cfg->db_addr_key_bytes);
 	if(db->Open()){
 		return 0;
 	}
@@ -55,13 +58,57 @@ int main(int argc, char* argv[]) {
 			return 0;
 		}
 		spdlog::info("BLK Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_TXNUM)) {
+			return 0;
+		}
+		spdlog::info("TXNUM Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_ADDRID)) {
+			return 0;
+		}
+		spdlog::info("ADDRID Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_HEIGHT)) {
+			return 0;
+		}
+		spdlog::info("HEIGHT Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_SPEND)) {
+			return 0;
+		}
+		spdlog::info("SPEND Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_BALANCE)) {
+			return 0;
+		}
+		spdlog::info("BALANCE Keys: {0:n}", stat.ms_entries);
+
+		if (db->GetTXOStats(&stat, DBI_STATUS)) {
+			return 0;
+		}
+		spdlog::info("STATUS Keys: {0:n}", stat.ms_entries);
 	}
 
 	spdlog::info("LMDB Version: {}", db->GetLMDBVersion());
 	if(preload->count > 0){
 		auto preloadDir = std::string(*preload->sval);
 		spdlog::info("Preloading DB from: {}", preloadDir);
-		db->PreLoadBlocks(preloadDir);
+
+		PreloadOptions opts;
+		opts.readThreads = cfg->preload_read_threads;
+		opts.parseThreads = cfg->preload_parse_threads;
+		opts.hashThreads = cfg->preload_hash_threads;
+		opts.queueDepth = cfg->preload_queue_depth;
+		opts.commitBlocks = cfg->preload_commit_blocks;
+		opts.commitMB = cfg->preload_commit_mb;
+		opts.cacheOutputs = cfg->preload_cache_outputs;
+		opts.undo = cfg->preload_undo;
+		opts.bulk = bulk->count > 0;
+		opts.sortMB = cfg->preload_sort_mb;
+		opts.sortDir = cfg->preload_sort_dir;
+		opts.checkMerkle = cfg->preload_check_merkle;
+		db->PreLoadBlocks(preloadDir, opts);
 		return 0;
 	}
 	
@@ -28,6 +28,16 @@ using namespace electrumz::commands;
 #define JSONRPC_DELIM '\n'
 #endif
 
+//history txs read and written at once
+#ifndef JSONRPC_HISTORY_CHUNK
+#define JSONRPC_HISTORY_CHUNK 1000
+#endif
+
+//history txs in one blockchain.scripthash.history page
+#ifndef JSONRPC_HISTORY_PAGE
+#define JSONRPC_HISTORY_PAGE 10000
+#endif
+
 #ifndef ELECTRUMZ_NO_SSL
 JsonRPCServer::JsonRPCServer(TXODB* db, uv_tcp_t* s, RPCClient* rpc, const Config* cfg, mbedtls_ssl_config* ssl_cfg)
 	: db(db), stream(s), config(cfg), ssl_config(ssl_cfg), ssl(nullptr), rpc(rpc) {
@@ -140,23 +150,41 @@ int JsonRPCServer::Write(ssize_t len, unsigned char* buf) {
 	return 0;
 }
 
+int JsonRPCServer::WriteAll(size_t len, const unsigned char* buf) {
+	//a TLS write takes at most one record, loop until all of it is out
+	size_t sent = 0;
+	while (sent < len) {
+		int n = this->Write(len - sent, const_cast<unsigned char*>(buf) + sent);
+		if (n <= 0) {
+			spdlog::error("Write failed: {}", n);
+			return 0;
+		}
+		sent += n;
+	}
+	return (int)len;
+}
+
 int JsonRPCServer::WriteInternal(ssize_t len, const unsigned char* buf) {
 	uv_buf_t* sbuf = new uv_buf_t[2];
 	sbuf[0].base = (char*)malloc(len);
 	sbuf[0].len = len;
 	sbuf[1].base = (char*)this; //this will do as our data pointer
-	sbuf[1].len = 0;
+	sbuf[1].len = this->historyWriting ? 1 : 0; //part of a history chunk
+	if (this->historyWriting) {
+		this->historyWrites++;
+	}
 
 	memcpy(sbuf[0].base, buf, len);
 
 	uv_write_t* req = new uv_write_t;
 	uv_req_set_data((uv_req_t*)req, sbuf);
 
-	if (uv_write(req, (uv_stream_t*)this->stream, sbuf, 1, [](uv_write_t* req, int status) {
-		auto srv = (uv_buf_t(*)[2])uv_req_get_data((uv_req_t*)req);
-		((JsonRPCServer*)srv[1]->base)->HandleWrite(req, status);
-		})) {
-		this->HandleWrite(req, 0);
+	int err = uv_write(req, (uv_stream_t*)this->stream, sbuf, 1, [](uv_write_t* req, int status) {
+		auto srv = (uv_buf_t*)uv_req_get_data((uv_req_t*)req);
+		((JsonRPCServer*)srv[1].base)->HandleWrite(req, status);
+		});
+	if (err) {
+		this->HandleWrite(req, err);
 		spdlog::error("Something went wrong");
 		return 0;
 	}
@@ -342,12 +370,18 @@ int JsonRPCServer::CommandError(int id, std::string msg, int err, nlohmann::json
 int JsonRPCServer::WriteInternal(const nlohmann::json& data) {
 	auto d = data.dump(-1, ' ', true);
 	spdlog::debug("Writing response: {}", d);
-	d.resize(d.size() + 1, '\n');
+	d.resize(d.size() + 1, JSONRPC_DELIM);
 
-	return WriteInternal(d.size(), (unsigned char*)d.data());
+	return WriteAll(d.size(), (unsigned char*)d.data());
 }
 
 int JsonRPCServer::HandleCommand(nlohmann::json&& cmd) {
+	//responses go out in order, nothing is written in the middle of a history
+	if (this->history.active) {
+		this->queued.push_back(std::move(cmd));
+		return 1;
+	}
+
 	if (cmd.is_null()) {
 		nlohmann::json jrsp;
 		CommandError(0, "Parser error", -32700, jrsp);
@@ -447,19 +481,43 @@ int JsonRPCServer::HandleCommand(nlohmann::json&& cmd) {
 			break;
 		}
 		case ElectrumCommands::SHGetBalance: {
-			nlohmann::json rsp;
-			SHGetBalanceResponse v = {};
+			std::string hash;
 
-			CommandSuccess(id, v, rsp);
-			WriteInternal(std::move(rsp));
+			nlohmann::json jrsp;
+			if (cmd["params"].is_array() && cmd["params"][0].is_string()) {
+				cmd["params"][0].get_to<std::string>(hash);
+			}
+
+			auto hexHash = ParseHex(hash);
+			if (hexHash.size() == 32) {
+				std::reverse(hexHash.begin(), hexHash.end());//dirty reverse
+
+				//one record, kept up to date as blocks are stored
+				AddrBalance balance;
+				int err = db->GetBalance(uint256(hexHash), balance);
+				if (err == TXO_OK || err == TXO_NOTFOUND) {
+					SHGetBalanceResponse v = { balance.Confirmed(), 0 };
+
+					CommandSuccess(id, v, jrsp);
+				}
+				else {
+					CommandError(id, "Internal error", -32603, jrsp);
+				}
+			}
+			else {
+				CommandError(id, "Invalid params", -32602, jrsp);
+			}
+			WriteInternal(std::move(jrsp));
 			break;
 		}
 		case ElectrumCommands::SHGetHistory: {
-			nlohmann::json rsp;
-			SHGetHistoryResponse v = {};
+			std::string hash;
+			if (cmd["params"].is_array() && cmd["params"][0].is_string()) {
+				cmd["params"][0].get_to<std::string>(hash);
+			}
 
-			CommandSuccess(id, v, rsp);
-			WriteInternal(std::move(rsp));
+			//the whole history, written in chunks as the socket takes them
+			StartHistory(id, hash, 0, false);
 			break;
 		}
 		case ElectrumCommands::SHGetMempool: {
@@ -471,11 +529,19 @@ int JsonRPCServer::HandleCommand(nlohmann::json&& cmd) {
 			break;
 		}
 		case ElectrumCommands::SHHistory: {
-			nlohmann::json rsp;
-			SHHistoryResponse v = {};
+			std::string hash;
+			uint64_t from = 0;
+			if (cmd["params"].is_array()) {
+				if (cmd["params"][0].is_string()) {
+					cmd["params"][0].get_to<std::string>(hash);
+				}
+				//resume token, the next of the last page
+				if (cmd["params"][1].is_number_unsigned()) {
+					cmd["params"][1].get_to<uint64_t>(from);
+				}
+			}
 
-			CommandSuccess(id, v, rsp);
-			WriteInternal(std::move(rsp));
+			StartHistory(id, hash, from, true);
 			break;
 		}
 		case ElectrumCommands::SHListUnspent: {
@@ -494,16 +560,21 @@ int JsonRPCServer::HandleCommand(nlohmann::json&& cmd) {
 					cmd["params"][0].get_to<std::string>(hash);
 				}
 
-				std::vector<TXO> txn;
 				auto hexHash = ParseHex(hash);
 				std::reverse(hexHash.begin(), hexHash.end());//dirty reverse
-				db->GetTXOs(uint256(hexHash), txn); 
 
+				//stored as blocks come in, nothing is rehashed here
 				SHSubscribeResponse rsp;
-
-				//do some stuff
-
-				CommandSuccess(id, rsp, jrsp);
+				int err = hexHash.size() == 32 ? db->GetStatus(uint256(hexHash), rsp.status.confirmed) : TXO_ERR;
+				if (err == TXO_OK || err == TXO_NOTFOUND) {
+					CommandSuccess(id, rsp, jrsp);
+				}
+				else if (hexHash.size() != 32) {
+					CommandError(id, "Invalid params", -32602, jrsp);
+				}
+				else {
+					CommandError(id, "Internal error", -32603, jrsp);
+				}
 				WriteInternal(std::move(jrsp));
 			}
 			else {
@@ -711,11 +782,119 @@ void JsonRPCServer::InitTLSContext() {
 #endif
 
 int JsonRPCServer::HandleWrite(uv_write_t * req, int status) {
-	auto srv = (uv_buf_t(*)[2])uv_req_get_data((uv_req_t*)req);
+	auto srv = (uv_buf_t*)uv_req_get_data((uv_req_t*)req);
+	bool chunk = srv[1].len != 0;
+
+	free(srv[0].base);
+	delete[] srv;
+	delete req;
+
+	if (!chunk) {
+		return 1;
+	}
+	this->historyWrites--;
+	if (status != 0) {
+		//the connection is gone, nothing more of the history can be sent
+		this->history.active = false;
+	}
+	//the last chunk of a history is sent, read the next one
+	else if (this->history.active && this->historyWrites == 0) {
+		this->WriteHistory();
+	}
+	return 1;
+}
+
+int JsonRPCServer::StartHistory(int id, const std::string& hash, uint64_t from, bool paged) {
+	auto hexHash = ParseHex(hash);
+	if (hexHash.size() != 32) {
+		nlohmann::json jrsp;
+		CommandError(id, "Invalid params", -32602, jrsp);
+		return WriteInternal(std::move(jrsp));
+	}
+	std::reverse(hexHash.begin(), hexHash.end());//dirty reverse
+
+	this->history = HistoryStream();
+	this->history.active = true;
+	this->history.id = id;
+	this->history.scriptHash = uint256(hexHash);
+	this->history.from = from;
+	if (paged) {
+		this->history.left = JSONRPC_HISTORY_PAGE;
+	}
+	this->history.paged = paged;
+	return this->WriteHistory();
+}
+
+int JsonRPCServer::WriteHistory() {
+	auto& h = this->history;
+
+	//the json is written by hand, a DOM of the whole history is what this avoids
+	std::string out;
+	bool first = !h.started;
+	if (first) {
+		out = "{\"id\":" + std::to_string(h.id) + ",\"jsonrpc\":\"2.0\",\"result\":";
+		out += h.paged ? "{\"history\":[" : "[";
+	}
+
+	std::optional<uint64_t> next;
+	uint64_t count = 0;
+	auto max = (size_t)(h.left ? std::min<uint64_t>(*h.left, JSONRPC_HISTORY_CHUNK) : JSONRPC_HISTORY_CHUNK);
+	int err = db->ReadHistory(h.scriptHash, h.from, max, [&](const uint256& txid, uint32_t height) {
+		if (h.written + count > 0) {
+			out += ",";
+		}
+		out += "{\"height\":" + std::to_string(height) + ",\"tx_hash\":\"" + txid.GetHex() + "\"}";
+		count++;
+	}, next);
+
+	if (err != TXO_OK) {
+		h.active = false;
+		if (first) {
+			nlohmann::json jrsp;
+			CommandError(h.id, "Internal error", -32603, jrsp);
+			WriteInternal(std::move(jrsp));
+		}
+		else {
+			//part of the response is sent already, the client can't use the rest
+			spdlog::error("History of {} failed, closing connection", h.scriptHash.GetHex());
+			this->End();
+			return 0;
+		}
+	}
+	else {
+		h.started = true;
+		h.written += count;
+		if (h.left) {
+			*h.left -= count;
+		}
+		if (next) {
+			h.from = *next;
+		}
+		if (!next || (h.left && *h.left == 0)) {
+			if (h.paged) {
+				out += std::string("],\"more\":") + (next ? "true" : "false") + ",\"next\":" + (next ? std::to_string(*next) : "null") + "}";
+			}
+			else {
+				out += "]";
+			}
+			out += "}";
+			out += JSONRPC_DELIM;
+			h.active = false;
+		}
 
-	srv[1]->base = nullptr;
-	free(srv[0]->base);
-	//free(srv);
-	free(req);
+		this->historyWriting = true;
+		int sent = WriteAll(out.size(), (unsigned char*)out.data());
+		this->historyWriting = false;
+		if (sent == 0) {
+			h.active = false;
+		}
+	}
+
+	//answer what came in meanwhile, unless it starts another history
+	while (!this->history.active && !this->queued.empty()) {
+		auto cmd = std::move(this->queued.front());
+		this->queued.pop_front();
+		this->HandleCommand(std::move(cmd));
+	}
 	return 1;
 }
\ No newline at end of file
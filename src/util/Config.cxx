@@ -65,6 +65,42 @@ void Config::from_json(std::ifstream &fi) {
 	if (j["zmqrawblock"].is_string()) {
 		this->zmqrawblock = j["zmqrawblock"].get<std::string>();
 	}
+	if (j["preload_read_threads"].is_number()) {
+		this->preload_read_threads = j["preload_read_threads"].get<unsigned int>();
+	}
+	if (j["preload_parse_threads"].is_number()) {
+		this->preload_parse_threads = j["preload_parse_threads"].get<unsigned int>();
+	}
+	if (j["preload_hash_threads"].is_number()) {
+		this->preload_hash_threads = j["preload_hash_threads"].get<unsigned int>();
+	}
+	if (j["preload_queue_depth"].is_number()) {
+		this->preload_queue_depth = j["preload_queue_depth"].get<unsigned int>();
+	}
+	if (j["preload_commit_blocks"].is_number()) {
+		this->preload_commit_blocks = j["preload_commit_blocks"].get<unsigned int>();
+	}
+	if (j["preload_commit_mb"].is_number()) {
+		this->preload_commit_mb = j["preload_commit_mb"].get<unsigned int>();
+	}
+	if (j["preload_cache_outputs"].is_number()) {
+		this->preload_cache_outputs = j["preload_cache_outputs"].get<unsigned int>();
+	}
+	if (j["preload_undo"].is_boolean()) {
+		this->preload_undo = j["preload_undo"].get<bool>();
+	}
+	if (j["preload_sort_mb"].is_number()) {
+		this->preload_sort_mb = j["preload_sort_mb"].get<unsigned int>();
+	}
+	if (j["preload_sort_dir"].is_string()) {
+		this->preload_sort_dir = j["preload_sort_dir"].get<std::string>();
+	}
+	if (j["preload_check_merkle"].is_boolean()) {
+		this->preload_check_merkle = j["preload_check_merkle"].get<bool>();
+	}
+	if (j["db_addr_key_bytes"].is_number()) {
+		this->db_addr_key_bytes = j["db_addr_key_bytes"].get<unsigned int>();
+	}
 #ifndef ELECTRUMZ_NO_SSL
 	if (j["ssl_cert"].is_string()) {
 		this->ssl_cert = j["ssl_cert"].get<std::string>();
@@ -0,0 +1,341 @@
+#include <electrumz/ExternalSort.h>
+
+#include <spdlog/spdlog.h>
+
+#include <filesystem>
+#include <algorithm>
+#include <queue>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace electrumz::util;
+
+/// Bytes of buffering for each run file while writing / merging
+constexpr size_t RUN_IO_BUFFER = 1024 * 1024 * 4;
+constexpr size_t RUN_IO_BUFFER_MIN = 1024 * 64;
+
+/// Most runs merged at once, more are merged down in passes first
+constexpr size_t RUN_MERGE_FANIN = 256;
+
+/// Same as LMDB's default compare (mdb_cmp_memn)
+static int MemnCompare(const MDB_val* a, const MDB_val* b) {
+	size_t len = std::min(a->mv_size, b->mv_size);
+	int diff = memcmp(a->mv_data, b->mv_data, len);
+	if (diff != 0) {
+		return diff;
+	}
+	return a->mv_size < b->mv_size ? -1 : a->mv_size > b->mv_size ? 1 : 0;
+}
+
+/**
+ * Sequential reader over one run file, holds the current record
+*/
+class RunReader {
+public:
+	~RunReader() {
+		if (this->f) {
+			fclose(this->f);
+		}
+	}
+
+	bool Open(const std::string& path, size_t bufSize) {
+		this->path = path;
+		this->f = fopen(path.c_str(), "rb");
+		if (this->f == nullptr) {
+			spdlog::error("Failed to open sort run {}: {}", path, strerror(errno));
+			return false;
+		}
+		setvbuf(this->f, nullptr, _IOFBF, bufSize);
+		return true;
+	}
+
+	/// Loads the next record, MDB_NOTFOUND at the end of the run
+	int Next() {
+		uint32_t lens[2];
+		auto len = fread(lens, 1, sizeof(lens), this->f);
+		if (len == 0 && feof(this->f)) {
+			return MDB_NOTFOUND;
+		}
+		if (len == sizeof(lens)) {
+			this->rec.resize((size_t)lens[0] + lens[1]);
+			if (this->rec.empty() || fread(this->rec.data(), this->rec.size(), 1, this->f) == 1) {
+				this->k = { lens[0], this->rec.data() };
+				this->v = { lens[1], this->rec.data() + lens[0] };
+				return 0;
+			}
+		}
+		if (ferror(this->f)) {
+			spdlog::error("Failed to read sort run {}: {}", this->path, strerror(errno));
+			return errno != 0 ? errno : EIO;
+		}
+
+		//a record cut short is a run file that was not written out fully
+		spdlog::error("Sort run {} is truncated", this->path);
+		return MDB_CORRUPTED;
+	}
+
+	MDB_val k, v;
+private:
+	FILE* f = nullptr;
+	std::string path;
+	std::vector<unsigned char> rec;
+};
+
+ExternalSorter::ExternalSorter(const std::string& dir, const std::string& name, uint64_t memLimit, MDB_cmp_func* dupCmp) {
+	this->dir = dir;
+	this->name = name;
+	this->memLimit = std::max<uint64_t>(memLimit, RUN_IO_BUFFER);
+	this->dupCmp = dupCmp;
+}
+
+ExternalSorter::~ExternalSorter() {
+	if (this->pending.valid()) {
+		this->pending.wait();
+	}
+	this->Clear();
+}
+
+int ExternalSorter::Compare(const MDB_val& ka, const MDB_val& va, const MDB_val& kb, const MDB_val& vb) const {
+	int cmp = MemnCompare(&ka, &kb);
+	if (cmp != 0) {
+		return cmp;
+	}
+	return this->dupCmp != nullptr ? this->dupCmp(&va, &vb) : MemnCompare(&va, &vb);
+}
+
+void ExternalSorter::AppendRecord(std::vector<unsigned char>& buf, const MDB_val& k, const MDB_val& v) {
+	uint32_t klen = (uint32_t)k.mv_size;
+	uint32_t vlen = (uint32_t)v.mv_size;
+	auto pos = buf.size();
+	buf.resize(pos + 8 + klen + vlen);
+
+	auto rec = buf.data() + pos;
+	memcpy(rec, &klen, 4);
+	memcpy(rec + 4, &vlen, 4);
+	memcpy(rec + 8, k.mv_data, klen);
+	memcpy(rec + 8 + klen, v.mv_data, vlen);
+}
+
+size_t ExternalSorter::ReadRecord(const unsigned char* rec, MDB_val& k, MDB_val& v) {
+	uint32_t klen, vlen;
+	memcpy(&klen, rec, 4);
+	memcpy(&vlen, rec + 4, 4);
+	k.mv_size = klen;
+	k.mv_data = (void*)(rec + 8);
+	v.mv_size = vlen;
+	v.mv_data = (void*)(rec + 8 + klen);
+	return 8 + (size_t)klen + vlen;
+}
+
+int ExternalSorter::Add(const void* key, uint32_t klen, const void* val, uint32_t vlen) {
+	this->offsets.push_back(this->buf.size());
+	AppendRecord(this->buf, MDB_val{ klen, (void*)key }, MDB_val{ vlen, (void*)val });
+
+	this->count++;
+	this->bytes += 8 + klen + vlen;
+
+	//half the limit each, one buffer fills while the other is written out
+	if (this->buf.size() + this->offsets.size() * sizeof(uint64_t) >= this->memLimit / 2) {
+		return this->Spill();
+	}
+	return 0;
+}
+
+int ExternalSorter::Spill() {
+	int err = 0;
+	if (this->pending.valid() && (err = this->pending.get())) {
+		return err;
+	}
+	if (this->offsets.empty()) {
+		return 0;
+	}
+
+	auto path = (std::filesystem::path(this->dir) / (this->name + "." + std::to_string(this->runs.size()) + ".run")).string();
+	this->runs.push_back(path);
+
+	//hand the full buffer to a background sort, keep filling a fresh one
+	auto sbuf = std::make_shared<std::vector<unsigned char>>(std::move(this->buf));
+	auto soff = std::make_shared<std::vector<uint64_t>>(std::move(this->offsets));
+	this->buf.clear();
+	this->offsets.clear();
+	this->buf.reserve(sbuf->capacity());
+	this->offsets.reserve(soff->capacity());
+
+	this->pending = std::async(std::launch::async, [this, sbuf, soff, path] {
+		return this->WriteRun(*sbuf, *soff, path);
+	});
+	return 0;
+}
+
+int ExternalSorter::WriteRun(std::vector<unsigned char>& buf, std::vector<uint64_t>& offsets, const std::string& path) {
+	auto base = buf.data();
+	std::sort(offsets.begin(), offsets.end(), [this, base](uint64_t a, uint64_t b) {
+		MDB_val ka, va, kb, vb;
+		ReadRecord(base + a, ka, va);
+		ReadRecord(base + b, kb, vb);
+		return this->Compare(ka, va, kb, vb) < 0;
+	});
+
+	auto f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		spdlog::error("Failed to create sort run {}: {}", path, strerror(errno));
+		return errno != 0 ? errno : -1;
+	}
+	setvbuf(f, nullptr, _IOFBF, RUN_IO_BUFFER);
+
+	for (auto o : offsets) {
+		MDB_val k, v;
+		auto len = ReadRecord(base + o, k, v);
+		if (fwrite(base + o, len, 1, f) != 1) {
+			spdlog::error("Failed to write sort run {}: {}", path, strerror(errno));
+			fclose(f);
+			return errno != 0 ? errno : -1;
+		}
+	}
+
+	if (fclose(f) != 0) {
+		spdlog::error("Failed to close sort run {}: {}", path, strerror(errno));
+		return errno != 0 ? errno : -1;
+	}
+	spdlog::debug("Wrote sort run {} ({} records)", path, offsets.size());
+	return 0;
+}
+
+int ExternalSorter::Finish() {
+	int err = 0;
+	if (err = this->Spill()) {
+		return err;
+	}
+	if (this->pending.valid()) {
+		err = this->pending.get();
+	}
+
+	//release the buffers before merging
+	std::vector<unsigned char>().swap(this->buf);
+	std::vector<uint64_t>().swap(this->offsets);
+	return err;
+}
+
+int ExternalSorter::Merge(const std::function<int(MDB_val&, MDB_val&)>& fn) {
+	int err = 0;
+
+	//an open file and a buffer per run, merge down until both fit
+	auto fanIn = std::max<size_t>(2, std::min<size_t>(RUN_MERGE_FANIN, this->memLimit / RUN_IO_BUFFER_MIN));
+	for (size_t pass = 0; this->runs.size() > fanIn; pass++) {
+		spdlog::info("Merging {} sort runs of {}, pass {}", this->runs.size(), this->name, pass);
+
+		std::vector<std::string> merged;
+		for (size_t x = 0; x < this->runs.size(); x += fanIn) {
+			std::vector<std::string> group(this->runs.begin() + x, this->runs.begin() + std::min(x + fanIn, this->runs.size()));
+			auto path = (std::filesystem::path(this->dir) / (this->name + ".p" + std::to_string(pass) + "." + std::to_string(merged.size()) + ".run")).string();
+			merged.push_back(path);
+
+			if (err = this->MergeToRun(group, path)) {
+				//drop what this pass wrote, the runs it read are still listed
+				for (const auto& m : merged) {
+					std::error_code ec;
+					std::filesystem::remove(m, ec);
+				}
+				return err;
+			}
+			for (const auto& r : group) {
+				std::error_code ec;
+				std::filesystem::remove(r, ec);
+			}
+		}
+		this->runs = std::move(merged);
+	}
+
+	return this->MergeRuns(this->runs, fn);
+}
+
+int ExternalSorter::MergeToRun(const std::vector<std::string>& runs, const std::string& path) {
+	auto f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		spdlog::error("Failed to create sort run {}: {}", path, strerror(errno));
+		return errno != 0 ? errno : -1;
+	}
+	setvbuf(f, nullptr, _IOFBF, RUN_IO_BUFFER);
+
+	std::vector<unsigned char> rec;
+	int err = this->MergeRuns(runs, [&](MDB_val& k, MDB_val& v) {
+		rec.clear();
+		AppendRecord(rec, k, v);
+		if (fwrite(rec.data(), rec.size(), 1, f) != 1) {
+			spdlog::error("Failed to write sort run {}: {}", path, strerror(errno));
+			return errno != 0 ? errno : -1;
+		}
+		return 0;
+	});
+
+	if (fclose(f) != 0 && err == 0) {
+		spdlog::error("Failed to close sort run {}: {}", path, strerror(errno));
+		err = errno != 0 ? errno : -1;
+	}
+	return err;
+}
+
+int ExternalSorter::MergeRuns(const std::vector<std::string>& runs, const std::function<int(MDB_val&, MDB_val&)>& fn) {
+	if (runs.empty()) {
+		return 0;
+	}
+
+	//split the memory budget between the runs
+	auto bufSize = std::max<size_t>(RUN_IO_BUFFER_MIN, std::min<size_t>(RUN_IO_BUFFER, this->memLimit / runs.size()));
+	std::vector<std::unique_ptr<RunReader>> readers;
+	for (const auto& r : runs) {
+		auto rr = std::make_unique<RunReader>();
+		if (!rr->Open(r, bufSize)) {
+			return errno != 0 ? errno : -1;
+		}
+		readers.push_back(std::move(rr));
+	}
+
+	auto greater = [this, &readers](size_t a, size_t b) {
+		const auto& ra = *readers[a];
+		const auto& rb = *readers[b];
+		int cmp = this->Compare(ra.k, ra.v, rb.k, rb.v);
+
+		//keep equal records in run order so the merge is stable
+		return cmp > 0 || (cmp == 0 && a > b);
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+
+	int err = 0;
+	for (size_t x = 0; x < readers.size(); x++) {
+		err = readers[x]->Next();
+		if (err == 0) {
+			heap.push(x);
+		}
+		else if (err != MDB_NOTFOUND) {
+			return err;
+		}
+	}
+
+	while (!heap.empty()) {
+		auto x = heap.top();
+		heap.pop();
+
+		if (err = fn(readers[x]->k, readers[x]->v)) {
+			return err;
+		}
+		err = readers[x]->Next();
+		if (err == 0) {
+			heap.push(x);
+		}
+		else if (err != MDB_NOTFOUND) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+void ExternalSorter::Clear() {
+	for (const auto& r : this->runs) {
+		std::error_code ec;
+		std::filesystem::remove(r, ec);
+	}
+	this->runs.clear();
+}
@@ -0,0 +1,143 @@
+#include <electrumz/MappedFile.h>
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+using namespace electrumz::util;
+
+MappedFile::~MappedFile() {
+	this->Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path) {
+	this->Close();
+
+	this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (this->file == INVALID_HANDLE_VALUE) {
+		this->file = nullptr;
+		spdlog::error("Failed to open {}: {}", path, GetLastError());
+		return false;
+	}
+
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(this->file, &fsize)) {
+		spdlog::error("Failed to get size of {}: {}", path, GetLastError());
+		this->Close();
+		return false;
+	}
+	this->len = fsize.QuadPart;
+	if (this->len == 0) {
+		return true;
+	}
+
+	this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->mapping == nullptr) {
+		spdlog::error("Failed to map {}: {}", path, GetLastError());
+		this->Close();
+		return false;
+	}
+
+	this->map = (unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (this->map == nullptr) {
+		spdlog::error("Failed to map view of {}: {}", path, GetLastError());
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+	if (this->map) {
+		UnmapViewOfFile(this->map);
+		this->map = nullptr;
+	}
+	if (this->mapping) {
+		CloseHandle(this->mapping);
+		this->mapping = nullptr;
+	}
+	if (this->file) {
+		CloseHandle(this->file);
+		this->file = nullptr;
+	}
+	this->len = 0;
+}
+
+void MappedFile::Advise(MapAccess access) {
+	//FILE_FLAG_SEQUENTIAL_SCAN is set on open, nothing else to hint here
+}
+#else
+bool MappedFile::Open(const std::string& path) {
+	this->Close();
+
+	this->fd = open(path.c_str(), O_RDONLY);
+	if (this->fd < 0) {
+		spdlog::error("Failed to open {}: {}", path, strerror(errno));
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(this->fd, &st)) {
+		spdlog::error("Failed to stat {}: {}", path, strerror(errno));
+		this->Close();
+		return false;
+	}
+	this->len = st.st_size;
+	if (this->len == 0) {
+		return true;
+	}
+
+	auto m = mmap(nullptr, this->len, PROT_READ, MAP_PRIVATE, this->fd, 0);
+	if (m == MAP_FAILED) {
+		spdlog::error("Failed to map {}: {}", path, strerror(errno));
+		this->Close();
+		return false;
+	}
+	this->map = (unsigned char*)m;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (this->map) {
+		munmap(this->map, this->len);
+		this->map = nullptr;
+	}
+	if (this->fd >= 0) {
+		close(this->fd);
+		this->fd = -1;
+	}
+	this->len = 0;
+}
+
+void MappedFile::Advise(MapAccess access) {
+	if (this->map == nullptr) {
+		return;
+	}
+
+	int advice = MADV_NORMAL;
+	switch (access) {
+	case MapAccess::Sequential:
+		advice = MADV_SEQUENTIAL;
+		break;
+	case MapAccess::Random:
+		advice = MADV_RANDOM;
+		break;
+	default:
+		break;
+	}
+
+	if (madvise(this->map, this->len, advice)) {
+		spdlog::debug("madvise failed: {}", strerror(errno));
+	}
+}
+#endif